@@ -0,0 +1,86 @@
+#include "arena.h"
+
+#include <stdlib.h>
+
+/// Rounds a size up to the arena alignment.
+/// @param size Size to be rounded.
+/// @return Smallest multiple of ARENA_ALIGNMENT not below size.
+static size_t align_up(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+/// Header size, rounded so that block data starts aligned.
+#define BLOCK_HEADER_SIZE align_up(sizeof(struct ArenaBlock))
+
+/// Allocates a new block. Blocks come from calloc so the whole arena is
+/// zero-initialized without touching the memory up front.
+/// @param size Usable bytes of the block.
+/// @return Pointer to the block, NULL on failure.
+static struct ArenaBlock *new_block(size_t size) {
+  struct ArenaBlock *block = calloc(1, BLOCK_HEADER_SIZE + size);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+void arena_init(struct Arena *arena) {
+  arena->blocks = NULL;
+  pthread_mutex_init(&arena->lock, NULL);
+}
+
+void *arena_alloc(struct Arena *arena, size_t size) {
+  size = align_up(size);
+
+  pthread_mutex_lock(&arena->lock);
+
+  struct ArenaBlock *block = arena->blocks;
+  if (block == NULL || block->size - block->used < size) {
+    if (size > ARENA_BLOCK_SIZE / 4) {
+      // Large requests get a block of their own, linked behind the current
+      // one so that its free space is not wasted
+      struct ArenaBlock *large = new_block(size);
+      if (large == NULL) {
+        pthread_mutex_unlock(&arena->lock);
+        return NULL;
+      }
+      large->used = size;
+      if (block == NULL) {
+        arena->blocks = large;
+        large->next = NULL;
+      } else {
+        large->next = block->next;
+        block->next = large;
+      }
+      pthread_mutex_unlock(&arena->lock);
+      return (char *)large + BLOCK_HEADER_SIZE;
+    }
+
+    block = new_block(ARENA_BLOCK_SIZE);
+    if (block == NULL) {
+      pthread_mutex_unlock(&arena->lock);
+      return NULL;
+    }
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+
+  void *memory = (char *)block + BLOCK_HEADER_SIZE + block->used;
+  block->used += size;
+
+  pthread_mutex_unlock(&arena->lock);
+  return memory;
+}
+
+void arena_destroy(struct Arena *arena) {
+  struct ArenaBlock *block = arena->blocks;
+  while (block != NULL) {
+    struct ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->blocks = NULL;
+  pthread_mutex_destroy(&arena->lock);
+}
@@ -0,0 +1,39 @@
+#ifndef EMS_ARENA_H
+#define EMS_ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT 16
+
+/// Block of memory handed out by an arena.
+struct ArenaBlock {
+  struct ArenaBlock *next; /// Previously allocated block.
+  size_t size;             /// Usable bytes in the block.
+  size_t used;             /// Bytes already handed out.
+};
+
+/// Bump allocator: memory is carved sequentially out of large blocks and is
+/// only released, all at once, when the arena is destroyed.
+struct Arena {
+  struct ArenaBlock *blocks; /// Most recent block first.
+  pthread_mutex_t lock;      /// Serializes concurrent allocations.
+};
+
+/// Initializes an empty arena.
+/// @param arena Arena to be initialized.
+void arena_init(struct Arena *arena);
+
+/// Allocates memory from an arena.
+/// @note The memory is zero-initialized and aligned to ARENA_ALIGNMENT.
+/// @param arena Arena to allocate from.
+/// @param size Number of bytes.
+/// @return Pointer to the memory, NULL on failure.
+void *arena_alloc(struct Arena *arena, size_t size);
+
+/// Releases every block of an arena.
+/// @param arena Arena to be destroyed.
+void arena_destroy(struct Arena *arena);
+
+#endif // EMS_ARENA_H
@@ -13,6 +13,19 @@ char *generate_filepath(char *filename) {
   return filepath;
 }
 
+char *change_extension(const char *filename, const char *extension) {
+  size_t base_len = strlen(filename) - JOB_F_E_LEN;
+  size_t extension_len = strlen(extension);
+  char *filepath = malloc(base_len + extension_len + 1);
+  if (filepath == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    return NULL;
+  }
+  memcpy(filepath, filename, base_len);
+  memcpy(filepath + base_len, extension, extension_len + 1);
+  return filepath;
+}
+
 int check_bytes_written(int out_file, const char *buffer, ssize_t bytes_written,
                         ssize_t bytes_to_write) {
   if (bytes_written == -1) {
@@ -32,4 +45,23 @@ int check_bytes_written(int out_file, const char *buffer, ssize_t bytes_written,
     }
     return 0;
   }
-}
\ No newline at end of file
+}
+
+size_t format_uint(char *buffer, unsigned int value) {
+  if (value < 10) {
+    buffer[0] = (char)('0' + value);
+    return 1;
+  }
+
+  char digits[UINT_MAX_DIGITS];
+  size_t len = 0;
+  while (value > 0) {
+    digits[len++] = (char)('0' + value % 10);
+    value /= 10;
+  }
+
+  for (size_t i = 0; i < len; i++) {
+    buffer[i] = digits[len - 1 - i];
+  }
+  return len;
+}
@@ -12,17 +12,35 @@
 
 #define EXTENSION_STR ".out"
 #define EXTENSION_LEN 4
-#define EVENT_LIST_BUFFER_SIZE 10 //"Event: 1\n"
-#define EVENT_LIST_CHARS_WRITTEN 7
-#define NO_EVENTS_BUFFER_SIZE 11 //"No events\n"
+#define EVENT_LIST_PREFIX "Event: "
+#define EVENT_LIST_PREFIX_LEN 7
+#define EVENT_LIST_LINE_MAX (EVENT_LIST_PREFIX_LEN + UINT_MAX_DIGITS + 1)
+#define NO_EVENTS_MESSAGE "No events\n"
+#define NO_EVENTS_LEN 10
 #define HELP_MESSAGE                                                           \
   ("Available commands:\n  CREATE <event_id> <num_rows> <num_columns>\n  "     \
-   "RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n  SHOW <event_id>\n  "   \
+   "RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n  "                      \
+   "RESERVE_BEST <event_id> <num_seats>\n  "                                   \
+   "TRANSACTION <event_id> [(<x1>,<y1>) ...] [<event_id> [...] ...]\n  "       \
+   "SHOW <event_id>\n  "                                                       \
    "LIST\n  WAIT <delay_ms> [thread_id]\n  BARRIER\n  HELP\n")
 #define HELP_BUFFER_SIZE (strlen(HELP_MESSAGE)+1)     // includes null terminator
+#define UINT_MAX_DIGITS 10 // digits of UINT_MAX (4294967295)
 
 char *generate_filepath(char *filename);
+
+/// Replaces the job file extension of a path.
+/// @param filename Path of a job file.
+/// @param extension New extension, including the dot.
+/// @return Newly allocated path, NULL on failure.
+char *change_extension(const char *filename, const char *extension);
 int check_bytes_written(int out_file, const char *buffer, ssize_t bytes_written,
                         ssize_t bytes_to_write);
 
+/// Formats an unsigned integer in decimal, without a null terminator.
+/// @param buffer Buffer with room for at least UINT_MAX_DIGITS characters.
+/// @param value Value to be formatted.
+/// @return Number of characters written.
+size_t format_uint(char *buffer, unsigned int value);
+
 #endif // P1_BASE_AUXILIAR_FUNCTIONS_H
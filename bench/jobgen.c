@@ -0,0 +1,276 @@
+// Synthetic workload generator for the EMS.
+//
+// Writes a set of .jobs files with a configurable mix of commands:
+//   ./jobgen [options] <output dir>
+//
+//   -n <files>      number of job files (default 4)
+//   -c <commands>   commands per job file (default 10000)
+//   -e <events>     events created per job file (default 16)
+//   -r <rows>       rows of each venue (default 20)
+//   -l <cols>       columns of each venue (default 20)
+//   -s <seats>      maximum seats per RESERVE (default 8)
+//   -x <percent>    RESERVEs that conflict with an earlier one (default 10)
+//   -w <percent>    SHOW commands (default 20)
+//   -t <percent>    LIST commands (default 5)
+//   -b <commands>   commands between BARRIERs, 0 for none (default 0)
+//   -z <seed>       random seed (default 1)
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct Config {
+  unsigned long files;
+  unsigned long commands;
+  unsigned long events;
+  unsigned long rows;
+  unsigned long cols;
+  unsigned long max_seats;
+  unsigned long conflict_pct;
+  unsigned long show_pct;
+  unsigned long list_pct;
+  unsigned long barrier_every;
+  unsigned long seed;
+};
+
+/// Parses a non-negative integer option.
+/// @param arg Option argument.
+/// @param value Pointer to the variable to store the value in.
+/// @return 0 if the argument is a valid number, 1 otherwise.
+static int parse_option(const char *arg, unsigned long *value) {
+  char *endptr;
+  errno = 0;
+  *value = strtoul(arg, &endptr, 10);
+  return errno != 0 || *endptr != '\0' || arg[0] == '\0';
+}
+
+/// Returns a pseudo-random number in [0, bound).
+/// @param state State of the generator.
+/// @param bound Upper bound, must be positive.
+static unsigned long next_random(unsigned long long *state,
+                                 unsigned long bound) {
+  // xorshift64*
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return (unsigned long)((*state * 2685821657736338717ULL) >> 33) % bound;
+}
+
+// State of a seat as seen by the generator
+enum SeatState {
+  SEAT_FREE,
+  SEAT_PENDING, // Picked by the reservation being generated
+  SEAT_TAKEN    // Reserved by an earlier reservation that succeeds
+};
+
+/// Looks for a seat in the given state, probing from a random one.
+/// @param seats States of the seats of an event.
+/// @param seats_per_event Number of seats of the event.
+/// @param wanted State to look for.
+/// @param state State of the generator.
+/// @return Index of the seat, or seats_per_event if there is none.
+static size_t find_seat(const unsigned char *seats, size_t seats_per_event,
+                        enum SeatState wanted, unsigned long long *state) {
+  size_t seat = next_random(state, seats_per_event);
+  for (size_t probes = 0; probes < seats_per_event; probes++) {
+    if (seats[seat] == wanted) {
+      return seat;
+    }
+    seat = (seat + 1) % seats_per_event;
+  }
+  return seats_per_event;
+}
+
+/// Writes one job file.
+/// @param cfg Workload configuration.
+/// @param path Path of the file to be written.
+/// @param seed Seed of this file.
+/// @return Number of commands written, 0 on error.
+static unsigned long write_job(const struct Config *cfg, const char *path,
+                               unsigned long long seed) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Failed to open %s\n", path);
+    return 0;
+  }
+
+  size_t seats_per_event = cfg->rows * cfg->cols;
+  unsigned char *taken = calloc(cfg->events * seats_per_event, 1);
+  size_t *picked = malloc(cfg->max_seats * sizeof(size_t));
+  if (taken == NULL || picked == NULL) {
+    fprintf(stderr, "Error allocating memory for seat map\n");
+    free(taken);
+    free(picked);
+    fclose(file);
+    return 0;
+  }
+
+  unsigned long long state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  unsigned long written = 0;
+
+  for (unsigned long e = 1; e <= cfg->events; e++) {
+    fprintf(file, "CREATE %lu %lu %lu\n", e, cfg->rows, cfg->cols);
+    written++;
+  }
+
+  while (written < cfg->commands) {
+    if (cfg->barrier_every > 0 && written % cfg->barrier_every == 0) {
+      fprintf(file, "BARRIER\n");
+      written++;
+      continue;
+    }
+
+    unsigned long event = next_random(&state, cfg->events);
+    unsigned long roll = next_random(&state, 100);
+
+    if (roll < cfg->show_pct) {
+      fprintf(file, "SHOW %lu\n", event + 1);
+    } else if (roll < cfg->show_pct + cfg->list_pct) {
+      fprintf(file, "LIST\n");
+    } else {
+      unsigned char *seats = taken + event * seats_per_event;
+      unsigned long num_seats = next_random(&state, cfg->max_seats) + 1;
+
+      // A conflicting reservation includes a seat of an earlier one, so it
+      // fails as a whole. Nothing can conflict before a seat is taken.
+      unsigned long conflict_at = num_seats;
+      if (next_random(&state, 100) < cfg->conflict_pct) {
+        size_t seat = find_seat(seats, seats_per_event, SEAT_TAKEN, &state);
+        if (seat < seats_per_event) {
+          conflict_at = next_random(&state, num_seats);
+          picked[conflict_at] = seat;
+        }
+      }
+
+      int fails = conflict_at < num_seats;
+      for (unsigned long i = 0; i < num_seats; i++) {
+        if (i == conflict_at) {
+          continue;
+        }
+        size_t seat = find_seat(seats, seats_per_event, SEAT_FREE, &state);
+        if (seat == seats_per_event) {
+          // The event is full, any seat makes the reservation fail
+          seat = next_random(&state, seats_per_event);
+          fails = 1;
+        } else {
+          seats[seat] = SEAT_PENDING;
+        }
+        picked[i] = seat;
+      }
+
+      // Only the seats of a reservation that succeeds are taken
+      fprintf(file, "RESERVE %lu [", event + 1);
+      for (unsigned long i = 0; i < num_seats; i++) {
+        size_t seat = picked[i];
+        if (seats[seat] == SEAT_PENDING) {
+          seats[seat] = fails ? SEAT_FREE : SEAT_TAKEN;
+        }
+        fprintf(file, "%s(%zu,%zu)", i > 0 ? " " : "", seat / cfg->cols + 1,
+                seat % cfg->cols + 1);
+      }
+      fprintf(file, "]\n");
+    }
+    written++;
+  }
+
+  free(picked);
+  free(taken);
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Failed to write %s\n", path);
+    return 0;
+  }
+  return written;
+}
+
+int main(int argc, char *argv[]) {
+  struct Config cfg = {4, 10000, 16, 20, 20, 8, 10, 20, 5, 0, 1};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:c:e:r:l:s:x:w:t:b:z:")) != -1) {
+    unsigned long *target;
+    switch (opt) {
+    case 'n':
+      target = &cfg.files;
+      break;
+    case 'c':
+      target = &cfg.commands;
+      break;
+    case 'e':
+      target = &cfg.events;
+      break;
+    case 'r':
+      target = &cfg.rows;
+      break;
+    case 'l':
+      target = &cfg.cols;
+      break;
+    case 's':
+      target = &cfg.max_seats;
+      break;
+    case 'x':
+      target = &cfg.conflict_pct;
+      break;
+    case 'w':
+      target = &cfg.show_pct;
+      break;
+    case 't':
+      target = &cfg.list_pct;
+      break;
+    case 'b':
+      target = &cfg.barrier_every;
+      break;
+    case 'z':
+      target = &cfg.seed;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [options] <output dir>\n", argv[0]);
+      return 1;
+    }
+
+    if (parse_option(optarg, target)) {
+      fprintf(stderr, "Invalid value for -%c: %s\n", opt, optarg);
+      return 1;
+    }
+  }
+
+  if (optind + 1 != argc) {
+    fprintf(stderr, "Usage: %s [options] <output dir>\n", argv[0]);
+    return 1;
+  }
+
+  if (cfg.events == 0 || cfg.events > UINT_MAX || cfg.rows == 0 ||
+      cfg.cols == 0 || cfg.max_seats == 0 ||
+      cfg.show_pct + cfg.list_pct > 100) {
+    fprintf(stderr, "Invalid workload configuration\n");
+    return 1;
+  }
+
+  const char *dirpath = argv[optind];
+  if (mkdir(dirpath, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Failed to create directory %s\n", dirpath);
+    return 1;
+  }
+
+  unsigned long total = 0;
+  for (unsigned long i = 0; i < cfg.files; i++) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/bench%lu.jobs", dirpath, i) >=
+        (int)sizeof(path)) {
+      fprintf(stderr, "Path too long\n");
+      return 1;
+    }
+
+    unsigned long written = write_job(&cfg, path, cfg.seed + i);
+    if (written == 0) {
+      return 1;
+    }
+    total += written;
+  }
+
+  printf("%lu\n", total);
+  return 0;
+}
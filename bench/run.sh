@@ -0,0 +1,61 @@
+#!/bin/sh
+# Throughput benchmark for the EMS.
+#
+# Generates a synthetic corpus with jobgen and runs ems over it with a zero
+# state access delay, once per combination of worker counts, reporting the
+# wall time and the number of commands executed per second.
+#
+# Environment:
+#   EMS           binary to benchmark (default ./ems)
+#   JOBGEN        generator binary (default ./jobgen)
+#   BENCH_DIR     where the corpus is generated (default bench/corpus)
+#   BENCH_GEN     extra options for jobgen (default "-n 8 -c 20000")
+#   BENCH_PROCS   values of <max jobs> to try (default "1 4")
+#   BENCH_THREADS values of <max threads> to try (default "1 2 4 8")
+#   BENCH_JOBC    1 to measure the compiled .jobc cache, 0 to measure the
+#                 text parser (default 0)
+
+EMS=${EMS:-./ems}
+JOBGEN=${JOBGEN:-./jobgen}
+BENCH_DIR=${BENCH_DIR:-bench/corpus}
+BENCH_GEN=${BENCH_GEN:--n 8 -c 20000}
+BENCH_PROCS=${BENCH_PROCS:-1 4}
+BENCH_THREADS=${BENCH_THREADS:-1 2 4 8}
+BENCH_JOBC=${BENCH_JOBC:-0}
+
+rm -rf "$BENCH_DIR"
+# shellcheck disable=SC2086
+commands=$("$JOBGEN" $BENCH_GEN "$BENCH_DIR") || exit 1
+
+# Every run leaves a .jobc next to each job, which later runs pick up. It is
+# either removed before every run or written once by an untimed run.
+if [ "$BENCH_JOBC" = 1 ]; then
+  path="compiled (.jobc)"
+  "$EMS" "$BENCH_DIR" 1 1 0 >/dev/null 2>&1 || {
+    echo "ems failed to compile the corpus" >&2
+    exit 1
+  }
+else
+  path="text (.jobs)"
+fi
+
+echo "corpus: $BENCH_DIR ($commands commands, jobgen $BENCH_GEN)"
+echo "path: $path"
+printf '%-6s %-8s %12s %14s\n' jobs threads wall_ms commands/s
+
+for procs in $BENCH_PROCS; do
+  for threads in $BENCH_THREADS; do
+    rm -f "$BENCH_DIR"/*.out "$BENCH_DIR"/*.stats
+    [ "$BENCH_JOBC" = 1 ] || rm -f "$BENCH_DIR"/*.jobc
+    start=$(date +%s%N)
+    "$EMS" "$BENCH_DIR" "$procs" "$threads" 0 >/dev/null 2>&1 || {
+      echo "ems failed with $procs jobs and $threads threads" >&2
+      exit 1
+    }
+    end=$(date +%s%N)
+    elapsed_ns=$((end - start))
+    [ "$elapsed_ns" -gt 0 ] || elapsed_ns=1
+    printf '%-6s %-8s %12d %14d\n' "$procs" "$threads" \
+      $((elapsed_ns / 1000000)) $((commands * 1000000000 / elapsed_ns))
+  done
+done
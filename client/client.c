@@ -0,0 +1,140 @@
+// Client of the EMS server: registers a session, streams a job to it and
+// prints the output of the job.
+//
+// ./ems_client <register pipe> [job file]
+//
+// The job is read from standard input when no file is given.
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../server.h"
+
+#define COPY_BUFFER_SIZE 65536
+
+/// Copies everything from one file descriptor to another.
+/// @param in_fd Descriptor to read from, until end of file.
+/// @param out_fd Descriptor to write to.
+/// @return 0 on success, 1 otherwise.
+static int copy_fd(int in_fd, int out_fd) {
+  char buffer[COPY_BUFFER_SIZE];
+  while (1) {
+    ssize_t bytes_read = read(in_fd, buffer, sizeof(buffer));
+    if (bytes_read == 0) {
+      return 0;
+    }
+    if (bytes_read < 0) {
+      return 1;
+    }
+
+    ssize_t done = 0;
+    while (done < bytes_read) {
+      ssize_t bytes_written =
+          write(out_fd, buffer + done, (size_t)(bytes_read - done));
+      if (bytes_written < 0) {
+        return 1;
+      }
+      done += bytes_written;
+    }
+  }
+}
+
+/// Prints the responses of the server while the job is still being sent, so
+/// that neither side blocks on a full pipe.
+/// @param arg Pointer to the descriptor of the response pipe.
+/// @return NULL on success, non-NULL otherwise.
+static void *print_responses(void *arg) {
+  int response_fd = *(int *)arg;
+  return copy_fd(response_fd, STDOUT_FILENO) ? arg : NULL;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <register pipe> [job file]\n", argv[0]);
+    return 1;
+  }
+
+  int job_fd = STDIN_FILENO;
+  if (argc == 3) {
+    job_fd = open(argv[2], O_RDONLY);
+    if (job_fd == -1) {
+      fprintf(stderr, "Failed to open job file %s\n", argv[2]);
+      return 1;
+    }
+  }
+
+  char message[SERVER_SETUP_SIZE];
+  memset(message, '\0', sizeof(message));
+  message[0] = SERVER_OP_SETUP;
+  char *request_pipe = message + 1;
+  char *response_pipe = message + 1 + SERVER_PIPE_PATH_MAX;
+  snprintf(request_pipe, SERVER_PIPE_PATH_MAX, "/tmp/ems_req_%ld",
+           (long)getpid());
+  snprintf(response_pipe, SERVER_PIPE_PATH_MAX, "/tmp/ems_resp_%ld",
+           (long)getpid());
+
+  unlink(request_pipe);
+  unlink(response_pipe);
+  if (mkfifo(request_pipe, 0640) != 0 || mkfifo(response_pipe, 0640) != 0) {
+    fprintf(stderr, "Failed to create session pipes\n");
+    unlink(request_pipe);
+    return 1;
+  }
+
+  int result = 1;
+  int register_fd = open(argv[1], O_WRONLY);
+  if (register_fd == -1) {
+    fprintf(stderr, "Failed to open register pipe %s\n", argv[1]);
+  } else if (write(register_fd, message, sizeof(message)) !=
+             (ssize_t)sizeof(message)) {
+    fprintf(stderr, "Failed to register session\n");
+    close(register_fd);
+  } else {
+    close(register_fd);
+
+    // Same order as the server, so the two opens meet
+    int request_fd = open(request_pipe, O_WRONLY);
+    int response_fd = request_fd == -1 ? -1 : open(response_pipe, O_RDONLY);
+    pthread_t printer;
+    if (response_fd == -1) {
+      fprintf(stderr, "Failed to open session pipes\n");
+    } else if (pthread_create(&printer, NULL, print_responses, &response_fd) !=
+               0) {
+      fprintf(stderr, "Failed to create thread\n");
+    } else {
+      result = copy_fd(job_fd, request_fd);
+      if (result) {
+        fprintf(stderr, "Failed to send job\n");
+      }
+      // The server ends the session once the request pipe is closed
+      close(request_fd);
+      request_fd = -1;
+
+      void *printer_result;
+      pthread_join(printer, &printer_result);
+      if (printer_result != NULL) {
+        fprintf(stderr, "Failed to read responses\n");
+        result = 1;
+      }
+    }
+
+    if (response_fd != -1) {
+      close(response_fd);
+    }
+    if (request_fd != -1) {
+      close(request_fd);
+    }
+  }
+
+  unlink(request_pipe);
+  unlink(response_pipe);
+  if (job_fd != STDIN_FILENO) {
+    close(job_fd);
+  }
+  return result;
+}
@@ -1,11 +1,13 @@
-#define MAX_RESERVATION_SIZE 256
+#define INITIAL_RESERVATION_SIZE 256
 #define STATE_ACCESS_DELAY_MS 10
 
 // Number of args incluiding the arg0 (the program name)
-#define NUM_MANDATORY_ARGS 3
-#define DELAY_ARG_INDEX 3
+#define NUM_MANDATORY_ARGS 4
+#define DELAY_ARG_INDEX 4
+#define MAX_THREADS_ARG_INDEX 3
 #define MAX_PROCS_ARG_INDEX 2
 #define DIR_ARG_INDEX 1
+#define REGISTER_PIPE_ARG_INDEX 1 // Takes the place of the directory with -s
 
 #define DT_REG 8
 
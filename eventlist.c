@@ -1,13 +1,134 @@
 #include "eventlist.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "auxiliar_functions.h"
+
+/// Hashes an event id into a slot of the index.
+/// @param event_id Event id.
+/// @param capacity Number of slots of the index, a power of two.
+/// @return Slot where the probe sequence for the id starts.
+static size_t index_slot(unsigned int event_id, size_t capacity) {
+  // The finalizer of splitmix64 makes every bit of the id affect the low
+  // bits kept by the mask, so strided ids spread as well as sequential ones
+  uint64_t hash = event_id;
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9u;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebu;
+  hash ^= hash >> 31;
+  return (size_t)hash & (capacity - 1);
+}
+
+/// Places an event in the first free slot of its probe sequence.
+/// @param index Index to place the event in.
+/// @param event Event to be placed.
+static void index_place(struct EventIndex *index, struct Event *event) {
+  size_t slot = index_slot(event->id, index->capacity);
+  while (atomic_load_explicit(&index->slots[slot], memory_order_relaxed) !=
+         NULL) {
+    slot = (slot + 1) & (index->capacity - 1);
+  }
+  atomic_store_explicit(&index->slots[slot], event, memory_order_release);
+}
+
+/// Allocates an empty index from the arena of a list.
+/// @param list Event list whose arena backs the index.
+/// @param capacity Number of slots, a power of two.
+/// @return Newly allocated index, NULL on failure.
+static struct EventIndex *index_alloc(struct EventList *list,
+                                      size_t capacity) {
+  // Arena memory is already zeroed, so every slot starts empty
+  struct EventIndex *index =
+      arena_alloc(&list->arena, sizeof(struct EventIndex) +
+                                    capacity * sizeof(struct Event *));
+  if (!index)
+    return NULL;
+  index->capacity = capacity;
+  return index;
+}
+
+/// Replaces the index with one of twice its capacity, rehashing every event.
+/// @param list Event list whose index is to be grown.
+/// @return 0 if the index was grown successfully, 1 otherwise.
+static int index_grow(struct EventList *list) {
+  struct EventIndex *old =
+      atomic_load_explicit(&list->index, memory_order_relaxed);
+  struct EventIndex *index = index_alloc(list, old->capacity * 2);
+  if (!index)
+    return 1;
+
+  for (size_t i = 0; i < old->capacity; i++) {
+    struct Event *event =
+        atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+    if (event != NULL) {
+      index_place(index, event);
+    }
+  }
+
+  // Readers still probing the old index find every event there too
+  atomic_store_explicit(&list->index, index, memory_order_release);
+  return 0;
+}
+
+/// Makes room in the listing of a list for one more line, replacing it with
+/// a larger copy if it is full.
+/// @param list Event list whose listing is to be grown.
+/// @return 0 if there is room, 1 otherwise.
+static int listing_reserve(struct EventList *list) {
+  size_t len = atomic_load_explicit(&list->listing_len, memory_order_relaxed);
+  if (len + EVENT_LIST_LINE_MAX <= list->listing_capacity)
+    return 0;
+
+  size_t capacity = list->listing_capacity == 0
+                        ? EVENT_LISTING_INITIAL_CAPACITY
+                        : list->listing_capacity * 2;
+  char *listing = arena_alloc(&list->arena, capacity);
+  if (!listing)
+    return 1;
+
+  char *old = atomic_load_explicit(&list->listing, memory_order_relaxed);
+  if (len > 0) {
+    memcpy(listing, old, len);
+  }
+  atomic_store_explicit(&list->listing, listing, memory_order_release);
+  list->listing_capacity = capacity;
+  return 0;
+}
+
+/// Appends the LIST line of an event to the rendered listing of a list.
+/// @note listing_reserve must have made room for the line.
+/// @param list Event list whose listing is to be extended.
+/// @param event_id Event id.
+static void listing_append(struct EventList *list, unsigned int event_id) {
+  size_t len = atomic_load_explicit(&list->listing_len, memory_order_relaxed);
+  char *line = atomic_load_explicit(&list->listing, memory_order_relaxed) + len;
+  memcpy(line, EVENT_LIST_PREFIX, EVENT_LIST_PREFIX_LEN);
+  size_t line_len = EVENT_LIST_PREFIX_LEN;
+  line_len += format_uint(line + line_len, event_id);
+  line[line_len++] = '\n';
+  atomic_store_explicit(&list->listing_len, len + line_len,
+                        memory_order_release);
+}
 
 struct EventList *create_list() {
   struct EventList *list = (struct EventList *)malloc(sizeof(struct EventList));
   if (!list)
     return NULL;
-  list->head = NULL;
+  atomic_init(&list->head, NULL);
   list->tail = NULL;
+  list->size = 0;
+  atomic_init(&list->listing, NULL);
+  atomic_init(&list->listing_len, 0);
+  list->listing_capacity = 0;
+  arena_init(&list->arena);
+
+  struct EventIndex *index = index_alloc(list, EVENT_INDEX_INITIAL_CAPACITY);
+  if (!index) {
+    arena_destroy(&list->arena);
+    free(list);
+    return NULL;
+  }
+  atomic_init(&list->index, index);
   return list;
 }
 
@@ -15,45 +136,104 @@ int append_to_list(struct EventList *list, struct Event *event) {
   if (!list)
     return 1;
 
+  // Everything that may fail happens before the event is published
+  struct EventIndex *index =
+      atomic_load_explicit(&list->index, memory_order_relaxed);
+  // Keep the load factor at or below 1/2 so probe sequences stay short
+  if ((list->size + 1) * 2 > index->capacity && index_grow(list) != 0)
+    return 1;
+
   struct ListNode *new_node =
-      (struct ListNode *)malloc(sizeof(struct ListNode));
-  if (!new_node)
+      arena_alloc(&list->arena, sizeof(struct ListNode));
+  if (!new_node || listing_reserve(list) != 0)
     return 1;
 
   new_node->event = event;
-  new_node->next = NULL;
+  atomic_init(&new_node->next, NULL);
 
-  if (list->head == NULL) {
-    list->head = new_node;
-    list->tail = new_node;
+  if (list->tail == NULL) {
+    atomic_store_explicit(&list->head, new_node, memory_order_release);
   } else {
-    list->tail->next = new_node;
-    list->tail = new_node;
+    atomic_store_explicit(&list->tail->next, new_node, memory_order_release);
   }
+  list->tail = new_node;
 
+  index_place(atomic_load_explicit(&list->index, memory_order_relaxed), event);
+  list->size++;
+
+  // Listed last, so an event in the output of LIST can always be found
+  listing_append(list, event->id);
   return 0;
 }
 
-static void free_event(struct Event *event) {
-  if (!event)
-    return;
+/// Initializes the fields and lock of a newly allocated event.
+/// @param event Event to be initialized.
+/// @param event_id Event id.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @param data Seat grid of the event.
+/// @param occupied Occupancy bitmap of the event.
+/// @return The event, NULL on failure.
+static struct Event *init_event(struct Event *event, unsigned int event_id,
+                                size_t num_rows, size_t num_cols,
+                                unsigned int *data,
+                                _Atomic uint64_t *occupied) {
+  if (pthread_rwlock_init(&event->lock, NULL) != 0)
+    return NULL;
+  if (pthread_mutex_init(&event->show_lock, NULL) != 0) {
+    pthread_rwlock_destroy(&event->lock);
+    return NULL;
+  }
+
+  event->id = event_id;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  event->reservations = 0;
+  event->occupied = occupied;
+  event->data = data;
+  event->free_runs = NULL;
+  event->show_cache = NULL;
+  return event;
+}
+
+struct Event *new_event(struct EventList *list, unsigned int event_id,
+                        size_t num_rows, size_t num_cols) {
+  size_t num_seats = num_rows * num_cols;
+  size_t num_words = (num_seats + SEATS_PER_WORD - 1) / SEATS_PER_WORD;
+
+  // The event, its bitmap and its seats share a single allocation. The
+  // bitmap goes first so its words stay aligned.
+  size_t header = (sizeof(struct Event) + sizeof(uint64_t) - 1) /
+                  sizeof(uint64_t) * sizeof(uint64_t);
+  char *memory =
+      arena_alloc(&list->arena, header + num_words * sizeof(uint64_t) +
+                                    num_seats * sizeof(unsigned int));
+  if (!memory)
+    return NULL;
+
+  // Arena memory is already zeroed, so every seat starts free
+  _Atomic uint64_t *occupied = (_Atomic uint64_t *)(memory + header);
+  return init_event((struct Event *)memory, event_id, num_rows, num_cols,
+                    (unsigned int *)(occupied + num_words), occupied);
+}
 
-  free(event->data);
-  free(event);
+struct Event *new_event_over(struct EventList *list, unsigned int event_id,
+                             size_t num_rows, size_t num_cols,
+                             unsigned int *data, _Atomic uint64_t *occupied) {
+  struct Event *event = arena_alloc(&list->arena, sizeof(struct Event));
+  if (!event)
+    return NULL;
+  return init_event(event, event_id, num_rows, num_cols, data, occupied);
 }
 
 void free_list(struct EventList *list) {
   if (!list)
     return;
 
-  struct ListNode *current = list->head;
-  while (current) {
-    struct ListNode *temp = current;
-    current = current->next;
+  for (struct ListNode *node = list->head; node != NULL; node = node->next)
+    show_cache_destroy(node->event->show_cache);
 
-    free_event(temp->event);
-    free(temp);
-  }
+  arena_destroy(&list->arena);
   free(list);
 }
 
@@ -61,15 +241,125 @@ struct Event *get_event(struct EventList *list, unsigned int event_id) {
   if (!list)
     return NULL;
 
-  struct ListNode *current = list->head;
-  while (current) {
-    struct Event *event = current->event;
+  struct EventIndex *index =
+      atomic_load_explicit(&list->index, memory_order_acquire);
+  size_t slot = index_slot(event_id, index->capacity);
+  struct Event *event;
+  while ((event = atomic_load_explicit(&index->slots[slot],
+                                       memory_order_acquire)) != NULL) {
     if (event->id == event_id) {
-      printf("FOUND EXISTING EVENT: event_id = %d\n", event_id);
       return event;
     }
-    current = current->next;
+    slot = (slot + 1) & (index->capacity - 1);
   }
 
   return NULL;
 }
+
+/// Gathers the consecutive seats of a sorted set that fall in the same word
+/// of the bitmap into one mask.
+/// @param indexes Indexes of the seats, in ascending order.
+/// @param num_seats Number of seats.
+/// @param i Position of the first seat of the word, advanced past its last.
+/// @param mask Where the mask of the word is stored.
+/// @return Index of the word, or SIZE_MAX if a seat is repeated.
+static size_t gather_word(const size_t *indexes, size_t num_seats, size_t *i,
+                          uint64_t *mask) {
+  size_t word = indexes[*i] / SEATS_PER_WORD;
+  *mask = 0;
+  for (; *i < num_seats && indexes[*i] / SEATS_PER_WORD == word; (*i)++) {
+    uint64_t bit = (uint64_t)1 << (indexes[*i] % SEATS_PER_WORD);
+    if (*mask & bit) {
+      return SIZE_MAX;
+    }
+    *mask |= bit;
+  }
+  return word;
+}
+
+/// Loads a word of the bitmap of an event.
+/// @param event Event whose bitmap is to be read.
+/// @param word Index of the word.
+/// @return The word.
+static uint64_t load_word(struct Event *event, size_t word) {
+  return atomic_load_explicit(&event->occupied[word], memory_order_relaxed);
+}
+
+int seats_free(struct Event *event, const size_t *indexes, size_t num_seats) {
+  size_t i = 0;
+  while (i < num_seats) {
+    uint64_t mask;
+    size_t word = gather_word(indexes, num_seats, &i, &mask);
+    if (word == SIZE_MAX || (load_word(event, word) & mask) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int claim_seats(struct Event *event, const size_t *indexes, size_t num_seats) {
+  // Every word is tested before any is written, so readers without the lock
+  // never see the seats of a failed reservation
+  if (!seats_free(event, indexes, num_seats)) {
+    return 1;
+  }
+
+  size_t i = 0;
+  while (i < num_seats) {
+    uint64_t mask;
+    size_t word = gather_word(indexes, num_seats, &i, &mask);
+    atomic_store_explicit(&event->occupied[word],
+                          load_word(event, word) | mask,
+                          memory_order_relaxed);
+  }
+
+  if (event->free_runs != NULL) {
+    for (i = 0; i < num_seats; i++) {
+      free_runs_take(event->free_runs, indexes[i]);
+    }
+  }
+  if (event->show_cache != NULL) {
+    for (i = 0; i < num_seats; i++) {
+      show_cache_mark(event->show_cache, indexes[i] / event->cols);
+    }
+  }
+  return 0;
+}
+
+void claim_run(struct Event *event, size_t first, size_t num_seats) {
+  for (size_t i = first; i < first + num_seats; i++) {
+    size_t word = i / SEATS_PER_WORD;
+    atomic_store_explicit(&event->occupied[word],
+                          load_word(event, word) |
+                              (uint64_t)1 << (i % SEATS_PER_WORD),
+                          memory_order_relaxed);
+    if (event->free_runs != NULL) {
+      free_runs_take(event->free_runs, i);
+    }
+  }
+  if (event->show_cache != NULL && num_seats > 0) {
+    show_cache_mark(event->show_cache, first / event->cols);
+  }
+}
+
+int index_free_runs(struct EventList *list, struct Event *event) {
+  if (event->free_runs != NULL)
+    return 0;
+
+  size_t size = free_runs_size(event->rows, event->cols);
+  if (size == 0)
+    return 1;
+
+  // The index and its nodes share a single allocation, like the event
+  size_t header = (sizeof(struct FreeRuns) + sizeof(uint64_t) - 1) /
+                  sizeof(uint64_t) * sizeof(uint64_t);
+  char *memory = arena_alloc(&list->arena, header + size);
+  if (!memory)
+    return 1;
+
+  struct FreeRuns *runs = (struct FreeRuns *)memory;
+  free_runs_init(runs, memory + header, event->rows, event->cols,
+                 event->occupied);
+  event->free_runs = runs;
+  return 0;
+}
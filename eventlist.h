@@ -1,7 +1,16 @@
 #ifndef EVENT_LIST_H
 #define EVENT_LIST_H
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "freeruns.h"
+#include "showcache.h"
+
+#define SEATS_PER_WORD 64
 
 struct Event {
   unsigned int id;           /// Event id
@@ -12,35 +21,151 @@ struct Event {
 
   unsigned int
       *data; /// Array of size rows * cols with the reservations for each seat.
+  _Atomic uint64_t *occupied; /// Bitmap with a set bit for each reserved
+                              /// seat, kept in sync with data. Written under
+                              /// the lock, read with or without it.
+
+  struct FreeRuns *free_runs; /// Index of the runs of free seats, NULL
+                              /// until the first RESERVE_BEST builds it.
+
+  struct ShowCache *show_cache; /// Rows rendered by the last SHOW, NULL
+                                /// until the first SHOW builds it.
+
+  pthread_rwlock_t lock; /// Guards reservations, data and free_runs. RESERVE
+                         /// takes it exclusively, SHOW shares it.
+  pthread_mutex_t show_lock; /// Guards show_cache among the SHOWs that share
+                             /// lock. Reservations, which mark its rows
+                             /// dirty, already exclude them.
 };
 
 struct ListNode {
   struct Event *event;
-  struct ListNode *next;
+  struct ListNode *_Atomic next; // Published with release, read with acquire
+};
+
+#define EVENT_INDEX_INITIAL_CAPACITY 64
+
+// Open-addressing hash index over the events, keyed by event id. A full
+// index is never resized in place: a larger copy replaces it, and the old one
+// is left in the arena for the readers that may still be probing it.
+struct EventIndex {
+  size_t capacity;              // Number of slots, always a power of two
+  struct Event *_Atomic slots[]; // NULL when empty
 };
 
 // Linked list structure
+//
+// Events are only ever appended, never removed, so readers need no lock.
+// Writers are serialized by the caller, and every node, index slot and
+// listing byte is fully written before a release store publishes it.
 struct EventList {
-  struct ListNode *head; // Head of the list
-  struct ListNode *tail; // Tail of the list
+  struct ListNode *_Atomic head; // Head of the list
+  struct ListNode *tail;         // Tail of the list, only used by writers
+
+  // The list above keeps the insertion order, the index only speeds up
+  // lookups
+  struct EventIndex *_Atomic index;
+  size_t size; // Number of events in the list
+
+  // Backs the nodes, events, seats, indexes and listings of the list, which
+  // are all released together when the list is freed
+  struct Arena arena;
+
+  // Rendered output of LIST, a line per event in insertion order. A full
+  // listing is replaced by a larger copy, the bytes a reader has seen never
+  // change.
+  char *_Atomic listing;       // NULL until the first event is appended
+  _Atomic size_t listing_len;  // Number of bytes published in listing
+  size_t listing_capacity;     // Size of listing
 };
 
+#define EVENT_LISTING_INITIAL_CAPACITY 1024
+
 /// Creates a new event list.
 /// @return Newly created event list, NULL on failure
 struct EventList *create_list();
 
-/// Appends a new node to the list.
+/// Appends a new node to the list, indexes its event and adds it to the
+/// rendered listing. Lookups and traversals may run concurrently, and see
+/// the event once this returns.
+/// @note The event id must not be already present in the list, and appends
+/// must not run concurrently.
 /// @param list Event list to be modified.
 /// @param data Event to be stored in the new node.
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int append_to_list(struct EventList *list, struct Event *data);
 
-/// Removes a node from the list.
-/// @param list Event list to be modified.
-/// @return 0 if the node was removed successfully, 1 otherwise.
+/// Marks a set of seats as occupied in the bitmap of an event.
+/// Seats are tested a word at a time, and every word is tested before any is
+/// written. If any of them is already occupied, or repeated in indexes, the
+/// bitmap is left untouched. Otherwise the index of free runs and the SHOW
+/// cache are updated along with it, if the event has them.
+/// @note The caller must hold the event lock exclusively.
+/// @param event Event whose seats are to be claimed.
+/// @param indexes Indexes of the seats, in ascending order.
+/// @param num_seats Number of seats.
+/// @return 0 if every seat was claimed, 1 otherwise.
+int claim_seats(struct Event *event, const size_t *indexes, size_t num_seats);
+
+/// Marks a run of consecutive free seats as occupied in the bitmap of an
+/// event, in its index of free runs and in its SHOW cache.
+/// @note The caller must hold the event lock exclusively, and the seats must
+/// be free.
+/// @param event Event whose seats are to be claimed.
+/// @param first Index of the first seat.
+/// @param num_seats Number of seats.
+void claim_run(struct Event *event, size_t first, size_t num_seats);
+
+/// Builds the index of the runs of free seats of an event, if it has none.
+/// The index is allocated from the arena of the list.
+/// @note The caller must hold the event lock exclusively.
+/// @param list Event list whose arena backs the index.
+/// @param event Event to be indexed.
+/// @return 0 if the event is indexed, 1 otherwise.
+int index_free_runs(struct EventList *list, struct Event *event);
+
+/// Checks whether a set of seats of an event are all free.
+/// @note May be called without the event lock. Seats are never released, so
+/// a seat seen occupied stays occupied, but a seat seen free may be claimed
+/// right after.
+/// @param event Event whose seats are to be checked.
+/// @param indexes Indexes of the seats, in ascending order.
+/// @param num_seats Number of seats.
+/// @return 1 if every seat is free and none is repeated, 0 otherwise.
+int seats_free(struct Event *event, const size_t *indexes, size_t num_seats);
+
+/// Allocates an event and its seats from the arena of a list.
+/// The event is not appended to the list. Its memory is only released by
+/// free_list, even if it is never appended.
+/// @param list Event list whose arena backs the event.
+/// @param event_id Event id.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @return Newly created event with every seat free, NULL on failure.
+struct Event *new_event(struct EventList *list, unsigned int event_id,
+                        size_t num_rows, size_t num_cols);
+
+/// Allocates an event from the arena of a list over seats stored elsewhere.
+/// The event is not appended to the list.
+/// @param list Event list whose arena backs the event.
+/// @param event_id Event id.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @param data Seat grid of num_rows * num_cols seats.
+/// @param occupied Occupancy bitmap, in sync with data.
+/// @return Newly created event, NULL on failure.
+struct Event *new_event_over(struct EventList *list, unsigned int event_id,
+                             size_t num_rows, size_t num_cols,
+                             unsigned int *data, _Atomic uint64_t *occupied);
+
+/// Frees the list along with every event allocated from it, and the SHOW
+/// caches of the events in the list.
+/// @note Event locks are not destroyed one by one, their memory goes away
+/// with the arena.
+/// @param list Event list to be freed.
 void free_list(struct EventList *list);
 
-/// Retrieves an event in the list.
+/// Retrieves an event in the list, without taking any lock.
 /// @param list Event list to be searched
 /// @param event_id Event id.
 /// @return Pointer to the event if found, NULL otherwise.
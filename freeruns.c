@@ -0,0 +1,115 @@
+#include "freeruns.h"
+
+#include "eventlist.h"
+
+/// Summarizes two adjacent ranges of the same length.
+/// @param left Summary of the left range.
+/// @param right Summary of the right range.
+/// @param len Length of each range.
+/// @return Summary of both ranges.
+static struct FreeRunNode combine(struct FreeRunNode left,
+                                  struct FreeRunNode right, uint32_t len) {
+  struct FreeRunNode node;
+  node.prefix = left.prefix == len ? len + right.prefix : left.prefix;
+  node.suffix = right.suffix == len ? len + left.suffix : right.suffix;
+  node.best = left.suffix + right.prefix;
+  if (left.best > node.best) {
+    node.best = left.best;
+  }
+  if (right.best > node.best) {
+    node.best = right.best;
+  }
+  return node;
+}
+
+size_t free_runs_size(size_t rows, size_t cols) {
+  size_t leaves = 1;
+  while (leaves < cols) {
+    leaves *= 2;
+  }
+
+  size_t row_size = 2 * leaves * sizeof(struct FreeRunNode);
+  if (leaves > UINT32_MAX / 2 || (rows != 0 && row_size > SIZE_MAX / rows)) {
+    return 0;
+  }
+  return rows * row_size;
+}
+
+void free_runs_init(struct FreeRuns *runs, void *memory, size_t rows,
+                    size_t cols, _Atomic uint64_t *occupied) {
+  runs->rows = rows;
+  runs->cols = cols;
+  runs->leaves = 1;
+  while (runs->leaves < cols) {
+    runs->leaves *= 2;
+  }
+  runs->nodes = memory;
+
+  for (size_t row = 0; row < rows; row++) {
+    struct FreeRunNode *tree = runs->nodes + row * 2 * runs->leaves;
+    for (size_t col = 0; col < runs->leaves; col++) {
+      size_t index = row * cols + col;
+      uint32_t free = 0;
+      if (col < cols) {
+        uint64_t word = atomic_load_explicit(
+            &occupied[index / SEATS_PER_WORD], memory_order_relaxed);
+        free = !(word >> (index % SEATS_PER_WORD) & 1);
+      }
+      tree[runs->leaves + col] = (struct FreeRunNode){free, free, free};
+    }
+
+    // Level by level, from the parents of the leaves up to the root
+    uint32_t len = 1;
+    for (size_t width = runs->leaves / 2; width >= 1; width /= 2, len *= 2) {
+      for (size_t i = width; i < 2 * width; i++) {
+        tree[i] = combine(tree[2 * i], tree[2 * i + 1], len);
+      }
+    }
+  }
+}
+
+void free_runs_take(struct FreeRuns *runs, size_t index) {
+  size_t row = index / runs->cols;
+  struct FreeRunNode *tree = runs->nodes + row * 2 * runs->leaves;
+
+  size_t i = runs->leaves + index % runs->cols;
+  tree[i] = (struct FreeRunNode){0, 0, 0};
+  for (uint32_t len = 1; i > 1; len *= 2) {
+    i /= 2;
+    tree[i] = combine(tree[2 * i], tree[2 * i + 1], len);
+  }
+}
+
+int free_runs_find(const struct FreeRuns *runs, size_t num_seats,
+                   size_t *index) {
+  for (size_t row = 0; row < runs->rows; row++) {
+    const struct FreeRunNode *tree = runs->nodes + row * 2 * runs->leaves;
+    if (tree[1].best < num_seats) {
+      continue;
+    }
+
+    // Prefer the left half, then a run across the middle, then the right
+    size_t i = 1;
+    size_t len = runs->leaves;
+    size_t first = 0;
+    while (i < runs->leaves) {
+      size_t half = len / 2;
+      const struct FreeRunNode *left = &tree[2 * i];
+      const struct FreeRunNode *right = &tree[2 * i + 1];
+      if (left->best >= num_seats) {
+        i = 2 * i;
+      } else if (left->suffix + right->prefix >= num_seats) {
+        first += half - left->suffix;
+        break;
+      } else {
+        i = 2 * i + 1;
+        first += half;
+      }
+      len = half;
+    }
+
+    *index = row * runs->cols + first;
+    return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,54 @@
+#ifndef EMS_FREERUNS_H
+#define EMS_FREERUNS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Node of the segment tree of a row, summarizing the free seats of a range
+/// of columns.
+struct FreeRunNode {
+  uint32_t prefix; /// Free seats at the start of the range.
+  uint32_t suffix; /// Free seats at the end of the range.
+  uint32_t best;   /// Longest run of free seats in the range.
+};
+
+/// Index of the runs of free seats of an event, with one segment tree per
+/// row. The leaves past the last column count as taken seats.
+struct FreeRuns {
+  size_t rows;
+  size_t cols;
+  size_t leaves;             /// Leaves of each tree, a power of two.
+  struct FreeRunNode *nodes; /// 2 * leaves nodes per row, the root at 1.
+};
+
+/// Gets the memory needed by the index of an event.
+/// @param rows Number of rows.
+/// @param cols Number of columns.
+/// @return Size in bytes, 0 if it does not fit in a size_t.
+size_t free_runs_size(size_t rows, size_t cols);
+
+/// Builds the index of an event from its occupancy bitmap.
+/// @param runs Index to be built.
+/// @param memory Memory for the nodes, of free_runs_size bytes.
+/// @param rows Number of rows.
+/// @param cols Number of columns.
+/// @param occupied Occupancy bitmap of the event.
+void free_runs_init(struct FreeRuns *runs, void *memory, size_t rows,
+                    size_t cols, _Atomic uint64_t *occupied);
+
+/// Marks a seat as taken, in O(log cols).
+/// @param runs Index to be updated.
+/// @param index Index of the seat.
+void free_runs_take(struct FreeRuns *runs, size_t index);
+
+/// Finds the leftmost run of free seats of the given length in the first row
+/// that has one. Each row is tested in O(1) and searched in O(log cols).
+/// @param runs Index to be searched.
+/// @param num_seats Length of the run, at least 1.
+/// @param index Where the index of the first seat of the run is stored.
+/// @return 0 if a run was found, 1 otherwise.
+int free_runs_find(const struct FreeRuns *runs, size_t num_seats,
+                   size_t *index);
+
+#endif // EMS_FREERUNS_H
@@ -0,0 +1,254 @@
+#include "image.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Rounds an offset up to the image alignment.
+/// @param offset Offset to be rounded.
+/// @return Smallest multiple of IMAGE_ALIGNMENT not below offset.
+static uint64_t align_up(uint64_t offset) {
+  return (offset + IMAGE_ALIGNMENT - 1) & ~(uint64_t)(IMAGE_ALIGNMENT - 1);
+}
+
+/// Gets the number of words in the occupancy bitmap of an event.
+/// @param num_seats Number of seats of the event.
+/// @return Number of words.
+static size_t bitmap_words(size_t num_seats) {
+  return (num_seats + SEATS_PER_WORD - 1) / SEATS_PER_WORD;
+}
+
+/// Makes the entries of the directory that holds a file durable, so that a
+/// file renamed into it survives a crash.
+/// @param filepath Path of the file.
+/// @return 0 on success, 1 otherwise.
+static int sync_parent_dir(const char *filepath) {
+  const char *slash = strrchr(filepath, '/');
+  char *dirpath;
+  if (slash == NULL) {
+    dirpath = strdup(".");
+  } else if (slash == filepath) {
+    dirpath = strdup("/");
+  } else {
+    dirpath = strndup(filepath, (size_t)(slash - filepath));
+  }
+  if (dirpath == NULL) {
+    return 1;
+  }
+
+  int fd = open(dirpath, O_RDONLY | O_DIRECTORY);
+  free(dirpath);
+  if (fd == -1) {
+    return 1;
+  }
+  int result = fsync(fd) != 0;
+  if (close(fd) != 0) {
+    result = 1;
+  }
+  return result;
+}
+
+/// Writes the seats of every event, filling in the table of events.
+/// @param list Event list to be saved.
+/// @param file Stream positioned after the table of events.
+/// @param table Table of events, whose offsets are already filled in.
+/// @return 0 on success, 1 otherwise.
+static int write_seats(struct EventList *list, FILE *file,
+                       struct ImageEvent *table) {
+  static const char padding[IMAGE_ALIGNMENT] = {0};
+  size_t i = 0;
+  for (struct ListNode *node = list->head; node != NULL;
+       node = node->next, i++) {
+    struct Event *event = node->event;
+    size_t num_seats = event->rows * event->cols;
+    size_t num_words = bitmap_words(num_seats);
+    size_t data_len = num_seats * sizeof(unsigned int);
+
+    pthread_rwlock_rdlock(&event->lock);
+    table[i].reservations = event->reservations;
+    int result =
+        fwrite(event->occupied, sizeof(uint64_t), num_words, file) !=
+            num_words ||
+        fwrite(event->data, sizeof(unsigned int), num_seats, file) != num_seats;
+    pthread_rwlock_unlock(&event->lock);
+
+    size_t padding_len = align_up(data_len) - data_len;
+    if (result || fwrite(padding, 1, padding_len, file) != padding_len) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int image_write(struct EventList *list, const char *filepath) {
+  struct ImageEvent *table = calloc(list->size, sizeof(struct ImageEvent));
+  char *tmp_filepath = malloc(strlen(filepath) + 32);
+  if ((table == NULL && list->size > 0) || tmp_filepath == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    free(table);
+    free(tmp_filepath);
+    return 1;
+  }
+  sprintf(tmp_filepath, "%s.%ld.tmp", filepath, (long)getpid());
+
+  FILE *file = fopen(tmp_filepath, "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Error opening file %s\n", tmp_filepath);
+    free(table);
+    free(tmp_filepath);
+    return 1;
+  }
+
+  struct ImageHeader header;
+  memset(&header, 0, sizeof(header));
+  strcpy(header.magic, IMAGE_MAGIC);
+  header.version = IMAGE_VERSION;
+  header.num_events = list->size;
+
+  // Dimensions never change, so the layout is known before any seat is read
+  uint64_t offset =
+      sizeof(struct ImageHeader) + list->size * sizeof(struct ImageEvent);
+  size_t i = 0;
+  for (struct ListNode *node = list->head; node != NULL;
+       node = node->next, i++) {
+    struct Event *event = node->event;
+    size_t num_seats = event->rows * event->cols;
+    table[i].id = event->id;
+    table[i].rows = event->rows;
+    table[i].cols = event->cols;
+    table[i].occupied_offset = offset;
+    offset += bitmap_words(num_seats) * sizeof(uint64_t);
+    table[i].data_offset = offset;
+    offset += align_up(num_seats * sizeof(unsigned int));
+  }
+
+  // The table is written twice, as the reservation counts are only known
+  // once the seats have been read under the event locks
+  int result =
+      fwrite(&header, sizeof(header), 1, file) != 1 ||
+      fwrite(table, sizeof(struct ImageEvent), list->size, file) !=
+          list->size ||
+      write_seats(list, file, table) != 0 ||
+      fseek(file, sizeof(header), SEEK_SET) != 0 ||
+      fwrite(table, sizeof(struct ImageEvent), list->size, file) != list->size;
+
+  // The data must be durable before the rename is, or a crash could leave a
+  // partial image in place of the old one after the log was truncated
+  if (result == 0) {
+    result = fflush(file) != 0 || fsync(fileno(file)) != 0;
+  }
+  if (fclose(file) != 0) {
+    result = 1;
+  }
+  if (result == 0 && (rename(tmp_filepath, filepath) != 0 ||
+                      sync_parent_dir(filepath) != 0)) {
+    result = 1;
+  }
+  if (result != 0) {
+    fprintf(stderr, "Error writing file %s\n", filepath);
+    unlink(tmp_filepath);
+  }
+
+  free(table);
+  free(tmp_filepath);
+  return result;
+}
+
+/// Checks that an event of an image lies within the mapping.
+/// @param entry Event to be checked.
+/// @param map_len Length of the mapping.
+/// @return 1 if the event is valid, 0 otherwise.
+static int valid_event(const struct ImageEvent *entry, size_t map_len) {
+  if (entry->cols != 0 && entry->rows > SIZE_MAX / entry->cols) {
+    return 0;
+  }
+  size_t num_seats = entry->rows * entry->cols;
+  if (num_seats > SIZE_MAX / sizeof(unsigned int)) {
+    return 0;
+  }
+  size_t occupied_len = bitmap_words(num_seats) * sizeof(uint64_t);
+  size_t data_len = num_seats * sizeof(unsigned int);
+
+  return entry->occupied_offset % sizeof(uint64_t) == 0 &&
+         entry->data_offset % sizeof(unsigned int) == 0 &&
+         entry->occupied_offset <= map_len &&
+         occupied_len <= map_len - entry->occupied_offset &&
+         entry->data_offset <= map_len &&
+         data_len <= map_len - entry->data_offset;
+}
+
+/// Appends the events of a mapped image to a list.
+/// @param list Event list to be filled.
+/// @param map Mapping of the image.
+/// @param map_len Length of the mapping.
+/// @return 0 on success, 1 if the image is invalid or memory ran out.
+static int load_events(struct EventList *list, char *map, size_t map_len) {
+  struct ImageHeader *header = (struct ImageHeader *)map;
+  if (memcmp(header->magic, IMAGE_MAGIC, IMAGE_MAGIC_LEN) != 0 ||
+      header->version != IMAGE_VERSION ||
+      header->num_events > (map_len - sizeof(struct ImageHeader)) /
+                               sizeof(struct ImageEvent)) {
+    fprintf(stderr, "Invalid image file\n");
+    return 1;
+  }
+
+  struct ImageEvent *table =
+      (struct ImageEvent *)(map + sizeof(struct ImageHeader));
+  for (uint64_t i = 0; i < header->num_events; i++) {
+    if (!valid_event(&table[i], map_len) ||
+        get_event(list, table[i].id) != NULL) {
+      fprintf(stderr, "Invalid image file\n");
+      return 1;
+    }
+
+    struct Event *event = new_event_over(
+        list, table[i].id, table[i].rows, table[i].cols,
+        (unsigned int *)(map + table[i].data_offset),
+        (_Atomic uint64_t *)(map + table[i].occupied_offset));
+    if (event == NULL || append_to_list(list, event) != 0) {
+      fprintf(stderr, "Error allocating memory for event\n");
+      return 1;
+    }
+    event->reservations = table[i].reservations;
+  }
+  return 0;
+}
+
+int image_load(struct EventList *list, const char *filepath, void **map,
+               size_t *map_len) {
+  int fd = open(filepath, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Error opening file %s\n", filepath);
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(struct ImageHeader)) {
+    fprintf(stderr, "Invalid image file\n");
+    close(fd);
+    return 1;
+  }
+
+  // Private and writable: reservations copy the pages they touch
+  size_t len = (size_t)st.st_size;
+  void *memory = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    fprintf(stderr, "Error mapping file %s\n", filepath);
+    return 1;
+  }
+
+  if (load_events(list, memory, len) != 0) {
+    munmap(memory, len);
+    return 1;
+  }
+
+  *map = memory;
+  *map_len = len;
+  return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef EMS_IMAGE_H
+#define EMS_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eventlist.h"
+
+// State images are a snapshot of every event of the EMS, laid out so that
+// they can be mapped into memory and used in place instead of being parsed.
+// Every position in the file is an offset from its start, so the mapping may
+// land at any address. Images are written in native byte order and are only
+// meant to be read on the machine that wrote them.
+//
+// Layout: a struct ImageHeader, num_events struct ImageEvent in list order,
+// then the seats of each event: its occupancy bitmap followed by its seat
+// grid, padded to IMAGE_ALIGNMENT.
+
+#define IMAGE_MAGIC "EMSIMAG"
+#define IMAGE_MAGIC_LEN 8 // includes null terminator
+#define IMAGE_VERSION 1
+#define IMAGE_ALIGNMENT 8
+
+struct ImageHeader {
+  char magic[IMAGE_MAGIC_LEN];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_events;
+};
+
+struct ImageEvent {
+  uint32_t id;
+  uint32_t reservations;
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t occupied_offset; // Offset of the occupancy bitmap
+  uint64_t data_offset;     // Offset of the seat grid
+};
+
+/// Writes an image of the events of a list.
+/// The image is written under a temporary name, synced and renamed into
+/// place, so readers never see a partial file. Once it returns 0, the image
+/// survives a crash.
+/// @note The caller must keep the list from changing. Each event is locked
+/// while its seats are copied, so the image is consistent event by event.
+/// @param list Event list to be saved.
+/// @param filepath Path of the image.
+/// @return 0 if the image was written successfully, 1 otherwise.
+int image_write(struct EventList *list, const char *filepath);
+
+/// Maps an image into memory and appends its events to a list.
+/// The seats of the events are used in place: the mapping is private, so
+/// reservations only copy the pages they modify and never reach the file.
+/// @param list Empty event list to be filled.
+/// @param filepath Path of the image.
+/// @param map Where the address of the mapping is stored.
+/// @param map_len Where the length of the mapping is stored.
+/// @return 0 if the image was loaded successfully, 1 otherwise. On failure
+/// nothing stays mapped and the list must be freed, as it may hold events
+/// whose seats were in the mapping.
+int image_load(struct EventList *list, const char *filepath, void **map,
+               size_t *map_len);
+
+#endif // EMS_IMAGE_H
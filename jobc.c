@@ -0,0 +1,305 @@
+#include "jobc.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define JOBC_COORD_CHUNK 64
+
+/// Fills a header with the identity of a source file.
+/// @param header Header to be filled.
+/// @param st Status of the source file.
+static void fill_header(struct JobcHeader *header, const struct stat *st) {
+  memset(header, 0, sizeof(*header));
+  strcpy(header->magic, JOBC_MAGIC);
+  header->version = JOBC_VERSION;
+  header->source_mtime_sec = (int64_t)st->st_mtim.tv_sec;
+  header->source_mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+  header->source_size = (uint64_t)st->st_size;
+}
+
+/// Writes the coordinates of a RESERVE as packed uint32_t values.
+/// @param file Stream to write to.
+/// @param coords Coordinates to be written.
+/// @param num_coords Number of coordinates.
+/// @return 0 on success, 1 otherwise.
+static int write_coords(FILE *file, const size_t *coords, size_t num_coords) {
+  uint32_t chunk[JOBC_COORD_CHUNK];
+  for (size_t i = 0; i < num_coords; i += JOBC_COORD_CHUNK) {
+    size_t len = num_coords - i < JOBC_COORD_CHUNK ? num_coords - i
+                                                   : JOBC_COORD_CHUNK;
+    for (size_t j = 0; j < len; j++) {
+      chunk[j] = (uint32_t)coords[i + j];
+    }
+    if (fwrite(chunk, sizeof(uint32_t), len, file) != len) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int jobc_writer_open(struct JobcWriter *writer, int jobs_fd,
+                     const char *jobc_filepath) {
+  struct stat st;
+  if (fstat(jobs_fd, &st) != 0) {
+    return 1;
+  }
+
+  writer->tmp_filepath = malloc(strlen(jobc_filepath) + 32);
+  writer->jobc_filepath = strdup(jobc_filepath);
+  if (writer->tmp_filepath == NULL || writer->jobc_filepath == NULL) {
+    fprintf(stderr, "Error allocating memory\n");
+    free(writer->tmp_filepath);
+    free(writer->jobc_filepath);
+    return 1;
+  }
+  sprintf(writer->tmp_filepath, "%s.%ld.tmp", jobc_filepath, (long)getpid());
+
+  writer->file = fopen(writer->tmp_filepath, "wb");
+  if (writer->file == NULL) {
+    fprintf(stderr, "Error opening file %s\n", writer->tmp_filepath);
+    free(writer->tmp_filepath);
+    free(writer->jobc_filepath);
+    return 1;
+  }
+
+  fill_header(&writer->header, &st);
+  writer->complete = 0;
+  writer->failed = fwrite(&writer->header, sizeof(writer->header), 1,
+                          writer->file) != 1;
+  return 0;
+}
+
+void jobc_writer_add(struct JobcWriter *writer, enum Command command,
+                     int parse_error, const struct CommandArgs *args) {
+  if (writer->failed || writer->complete) {
+    return;
+  }
+  if (command == EOC) {
+    writer->complete = 1;
+    return;
+  }
+  if (command == CMD_EMPTY && !parse_error) {
+    return;
+  }
+
+  struct JobcRecord record;
+  memset(&record, 0, sizeof(record));
+  record.command = (uint8_t)command;
+
+  if (parse_error) {
+    // Execution stops at the first malformed command, so does compilation
+    record.flags = JOBC_PARSE_ERROR;
+    writer->header.num_records++;
+    writer->failed = fwrite(&record, sizeof(record), 1, writer->file) != 1;
+    writer->complete = 1;
+    return;
+  }
+
+  switch (command) {
+  case CMD_CREATE:
+    record.arg0 = args->event_id;
+    record.arg1 = (uint32_t)args->num_rows;
+    record.arg2 = (uint32_t)args->num_cols;
+    break;
+  case CMD_RESERVE:
+    record.arg0 = args->event_id;
+    record.arg1 = (uint32_t)args->num_coords;
+    break;
+  case CMD_RESERVE_BEST:
+    record.arg0 = args->event_id;
+    record.arg1 = (uint32_t)args->num_seats;
+    break;
+  case CMD_TRANSACTION:
+    record.arg1 = (uint32_t)args->num_coords;
+    break;
+  case CMD_SHOW:
+    record.arg0 = args->event_id;
+    break;
+  case CMD_WAIT:
+    record.arg0 = args->delay;
+    if (args->has_thread_id) {
+      record.flags = JOBC_THREAD_ID;
+      record.arg1 = args->thread_id;
+    }
+    break;
+  case CMD_LIST_EVENTS:
+  case CMD_BARRIER:
+  case CMD_HELP:
+  case CMD_EMPTY:
+  case CMD_INVALID:
+  case EOC:
+    break;
+  }
+
+  FILE *file = writer->file;
+  if (fwrite(&record, sizeof(record), 1, file) != 1 ||
+      (command == CMD_TRANSACTION &&
+       write_coords(file, args->es, args->num_coords)) ||
+      ((command == CMD_RESERVE || command == CMD_TRANSACTION) &&
+       (write_coords(file, args->xs, args->num_coords) ||
+        write_coords(file, args->ys, args->num_coords)))) {
+    writer->failed = 1;
+    return;
+  }
+  writer->header.num_records++;
+}
+
+int jobc_writer_close(struct JobcWriter *writer) {
+  int result = writer->failed || !writer->complete;
+
+  // The record count is only known at the end
+  if (result == 0) {
+    result = fseek(writer->file, 0, SEEK_SET) != 0 ||
+             fwrite(&writer->header, sizeof(writer->header), 1,
+                    writer->file) != 1;
+  }
+  if (fclose(writer->file) != 0) {
+    result = 1;
+  }
+  if (result == 0 && rename(writer->tmp_filepath, writer->jobc_filepath) != 0) {
+    result = 1;
+  }
+  if (result != 0) {
+    if (writer->failed) {
+      fprintf(stderr, "Error writing file %s\n", writer->jobc_filepath);
+    }
+    unlink(writer->tmp_filepath);
+  }
+
+  free(writer->tmp_filepath);
+  free(writer->jobc_filepath);
+  return result;
+}
+
+int jobc_is_fresh(const char *jobs_filepath, const char *jobc_filepath) {
+  struct stat st;
+  if (stat(jobs_filepath, &st) != 0) {
+    return 0;
+  }
+
+  int fd = open(jobc_filepath, O_RDONLY);
+  if (fd == -1) {
+    return 0;
+  }
+
+  struct JobcHeader header;
+  ssize_t bytes_read = read(fd, &header, sizeof(header));
+  close(fd);
+
+  struct JobcHeader expected;
+  fill_header(&expected, &st);
+
+  return bytes_read == (ssize_t)sizeof(header) &&
+         memcmp(header.magic, expected.magic, JOBC_MAGIC_LEN) == 0 &&
+         header.version == expected.version &&
+         header.source_mtime_sec == expected.source_mtime_sec &&
+         header.source_mtime_nsec == expected.source_mtime_nsec &&
+         header.source_size == expected.source_size;
+}
+
+int jobc_read_header(struct Reader *reader) {
+  struct JobcHeader header;
+  if (reader_read(reader, (char *)&header, sizeof(header)) !=
+          sizeof(header) ||
+      memcmp(header.magic, JOBC_MAGIC, JOBC_MAGIC_LEN) != 0 ||
+      header.version != JOBC_VERSION) {
+    fprintf(stderr, "Invalid compiled job file\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Reads packed uint32_t coordinates.
+/// @param reader Reader to read from.
+/// @param coords Array to store the coordinates in.
+/// @param num_coords Number of coordinates.
+/// @return 0 on success, 1 if the file ended early.
+static int read_coords(struct Reader *reader, size_t *coords,
+                       size_t num_coords) {
+  uint32_t chunk[JOBC_COORD_CHUNK];
+  for (size_t i = 0; i < num_coords; i += JOBC_COORD_CHUNK) {
+    size_t len = num_coords - i < JOBC_COORD_CHUNK ? num_coords - i
+                                                   : JOBC_COORD_CHUNK;
+    if (reader_read(reader, (char *)chunk, len * sizeof(uint32_t)) !=
+        len * sizeof(uint32_t)) {
+      return 1;
+    }
+    for (size_t j = 0; j < len; j++) {
+      coords[i + j] = chunk[j];
+    }
+  }
+  return 0;
+}
+
+int jobc_next(struct Reader *reader, enum Command *command,
+              struct CommandArgs *args) {
+  struct JobcRecord record;
+  size_t bytes_read = reader_read(reader, (char *)&record, sizeof(record));
+  if (bytes_read == 0) {
+    *command = EOC;
+    return 0;
+  }
+
+  if (bytes_read != sizeof(record) || record.command > EOC) {
+    fprintf(stderr, "Invalid compiled job file\n");
+    *command = EOC;
+    return 1;
+  }
+
+  *command = (enum Command)record.command;
+  if (record.flags & JOBC_PARSE_ERROR) {
+    return 1;
+  }
+
+  switch (*command) {
+  case CMD_CREATE:
+    args->event_id = record.arg0;
+    args->num_rows = record.arg1;
+    args->num_cols = record.arg2;
+    break;
+  case CMD_RESERVE:
+    args->event_id = record.arg0;
+    args->num_coords = record.arg1;
+    if (command_args_reserve(args, args->num_coords) ||
+        read_coords(reader, args->xs, args->num_coords) ||
+        read_coords(reader, args->ys, args->num_coords)) {
+      fprintf(stderr, "Invalid compiled job file\n");
+      return 1;
+    }
+    break;
+  case CMD_RESERVE_BEST:
+    args->event_id = record.arg0;
+    args->num_seats = record.arg1;
+    break;
+  case CMD_TRANSACTION:
+    args->num_coords = record.arg1;
+    if (command_args_reserve(args, args->num_coords) ||
+        read_coords(reader, args->es, args->num_coords) ||
+        read_coords(reader, args->xs, args->num_coords) ||
+        read_coords(reader, args->ys, args->num_coords)) {
+      fprintf(stderr, "Invalid compiled job file\n");
+      return 1;
+    }
+    break;
+  case CMD_SHOW:
+    args->event_id = record.arg0;
+    break;
+  case CMD_WAIT:
+    args->delay = record.arg0;
+    args->has_thread_id = (record.flags & JOBC_THREAD_ID) != 0;
+    args->thread_id = record.arg1;
+    break;
+  case CMD_LIST_EVENTS:
+  case CMD_BARRIER:
+  case CMD_HELP:
+  case CMD_EMPTY:
+  case CMD_INVALID:
+  case EOC:
+    break;
+  }
+  return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef EMS_JOBC_H
+#define EMS_JOBC_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "parser.h"
+#include "reader.h"
+
+// Compiled job files (.jobc) are a cache of the commands of a .jobs file in a
+// fixed-width binary form, so that they can be executed without parsing text.
+// They are written in native byte order and are only meant to be read on the
+// machine that wrote them.
+//
+// Layout: a struct JobcHeader followed by one struct JobcRecord per command.
+// A RESERVE record is followed by its rows and then its columns, each as
+// num_coords packed uint32_t values. A TRANSACTION record is followed by the
+// events of its coordinates, then its rows and then its columns.
+
+#define JOBC_FILE_EXTENSION ".jobc"
+#define JOBC_MAGIC "EMSJOBC"
+#define JOBC_MAGIC_LEN 8 // includes null terminator
+#define JOBC_VERSION 3
+
+#define JOBC_PARSE_ERROR 0x1 // The command was malformed in the source
+#define JOBC_THREAD_ID 0x2   // WAIT record that targets a thread
+
+struct JobcHeader {
+  char magic[JOBC_MAGIC_LEN];
+  uint32_t version;
+  uint32_t reserved;
+  int64_t source_mtime_sec;  // Modification time of the .jobs file
+  int64_t source_mtime_nsec;
+  uint64_t source_size;      // Size of the .jobs file
+  uint64_t num_records;
+};
+
+struct JobcRecord {
+  uint8_t command; // enum Command
+  uint8_t flags;   // JOBC_PARSE_ERROR, JOBC_THREAD_ID
+  uint16_t reserved;
+  uint32_t arg0;   // event id (CREATE, RESERVE, RESERVE_BEST, SHOW),
+                   // delay (WAIT)
+  uint32_t arg1;   // rows (CREATE), number of coordinates (RESERVE,
+                   // TRANSACTION), number of seats (RESERVE_BEST),
+                   // thread id (WAIT)
+  uint32_t arg2;   // columns (CREATE)
+};
+
+// Writes a .jobc file one command at a time, as the commands of its source
+// are parsed
+struct JobcWriter {
+  FILE *file;
+  char *tmp_filepath;
+  char *jobc_filepath;
+  struct JobcHeader header;
+  int complete; // The end of the source, or a malformed command, was reached
+  int failed;   // Writing failed, the file is discarded
+};
+
+/// Starts writing a compiled file under a temporary name.
+/// @param writer Writer to be initialized.
+/// @param jobs_fd File descriptor of the source file, before it is read.
+/// @param jobc_filepath Path of the compiled file.
+/// @return 0 if the writer was initialized successfully, 1 otherwise.
+int jobc_writer_open(struct JobcWriter *writer, int jobs_fd,
+                     const char *jobc_filepath);
+
+/// Adds the result of parsing the next command of the source.
+/// Empty commands are skipped, and nothing is added after the end of the
+/// source or the first malformed command.
+/// @param writer Writer to add the command to.
+/// @param command Command that was parsed.
+/// @param parse_error 1 if the command was malformed.
+/// @param args Arguments of the command.
+void jobc_writer_add(struct JobcWriter *writer, enum Command command,
+                     int parse_error, const struct CommandArgs *args);
+
+/// Finishes a compiled file. It is renamed into place only if the whole
+/// source was added, so readers never see a partial file; otherwise it is
+/// discarded.
+/// @param writer Writer to be closed.
+/// @return 0 if the compiled file was written, 1 otherwise.
+int jobc_writer_close(struct JobcWriter *writer);
+
+/// Checks whether a compiled file matches the current state of its source.
+/// @param jobs_filepath Path of the source file.
+/// @param jobc_filepath Path of the compiled file.
+/// @return 1 if the compiled file exists and is up to date, 0 otherwise.
+int jobc_is_fresh(const char *jobs_filepath, const char *jobc_filepath);
+
+/// Reads and validates the header of a compiled file.
+/// @param reader Reader positioned at the start of the file.
+/// @return 0 if the header is valid, 1 otherwise.
+int jobc_read_header(struct Reader *reader);
+
+/// Reads the next command of a compiled file. Returns EOC at the end.
+/// @param reader Reader positioned after the header.
+/// @param command Pointer to the variable to store the command in.
+/// @param args Arguments of the command, set up with command_args_init.
+/// @return 0 if the command was read successfully, 1 if it was malformed.
+int jobc_next(struct Reader *reader, enum Command *command,
+              struct CommandArgs *args);
+
+#endif // EMS_JOBC_H
@@ -29,6 +29,7 @@ int append_to_linkedList(list_t *list, char *data) {
   }
 
   new_node->data = strdup(data);
+  new_node->cost = 0;
   new_node->next = NULL;
 
   if (list->head == NULL) {
@@ -42,6 +43,43 @@ int append_to_linkedList(list_t *list, char *data) {
   return 0;
 }
 
+// Inserts before the first node with a lower cost, keeping the list sorted by
+// decreasing cost and equal costs in insertion order
+int insert_sorted_linkedList(list_t *list, char *data, long cost) {
+  if (list == NULL) {
+    fprintf(stderr, "Error: list is NULL\n");
+    return 1;
+  }
+
+  node_t *new_node = (node_t *)malloc(sizeof(node_t));
+  if (new_node == NULL) {
+    fprintf(stderr, "Error creating new node\n");
+    return 1;
+  }
+
+  new_node->data = strdup(data);
+  new_node->cost = cost;
+
+  node_t *previous = NULL;
+  node_t *current = list->head;
+  while (current != NULL && current->cost >= cost) {
+    previous = current;
+    current = current->next;
+  }
+
+  new_node->next = current;
+  if (previous == NULL) {
+    list->head = new_node;
+  } else {
+    previous->next = new_node;
+  }
+  if (current == NULL) {
+    list->tail = new_node;
+  }
+  list->size++;
+  return 0;
+}
+
 void free_linkedList_node(node_t *node) {
   if (node == NULL)
     return;
@@ -71,9 +109,12 @@ char *pop_linkedList(list_t *list) {
     return NULL;
 
   list->head = current->next;
+  if (list->head == NULL)
+    list->tail = NULL;
 
-  char *data = strdup(current->data);
-  free_linkedList_node(current);
+  // The caller takes ownership of the string, only the node is freed
+  char *data = current->data;
+  free(current);
 
   list->size--;
 
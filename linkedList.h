@@ -12,6 +12,7 @@
 
 typedef struct node {
   char *data;
+  long cost; // Estimated cost of the job, used to order the list
   struct node *next;
 } node_t;
 
@@ -23,6 +24,7 @@ typedef struct list {
 
 list_t *create_linkedList();
 int append_to_linkedList(list_t *list, char *data);
+int insert_sorted_linkedList(list_t *list, char *data, long cost);
 void free_linkedList_node(node_t *node);
 void free_linkedList(list_t *list);
 char *pop_linkedList(list_t *list);
@@ -1,23 +1,444 @@
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/dirent.h>
-#include <sys/fcntl.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "auxiliar_functions.h"
 #include "constants.h"
+#include "jobc.h"
 #include "linkedList.h"
 #include "main.h"
 #include "operations.h"
+#include "output.h"
 #include "parser.h"
+#include "reader.h"
+#include "server.h"
+#include "stats.h"
 
 static list_t *file_list = NULL;
 
-// ./ems <dir> <max jobs> <max threads> [delay]
+#define WATCH_BUFFER_SIZE 4096
+
+enum JobState {
+  JOB_RUNNING,  // Workers are parsing and executing commands
+  JOB_BARRIER,  // A BARRIER was read, workers drain and exit
+  JOB_FINISHED, // The end of the job was reached
+  JOB_FAILED    // A malformed command aborted the job
+};
+
+// State shared by the worker threads of a job
+struct Job {
+  struct Reader *reader;       // Shared parse stream
+  struct Output *out;          // Shared output of the job
+  int compiled;                // 1 if the reader is over a .jobc file
+  int interactive;             // 1 if every response is flushed right away
+  struct JobcWriter *jobc;     // Records the parsed commands, may be NULL
+  unsigned int num_threads;    // Number of worker threads
+  unsigned int *pending_waits; // Delay each thread must wait, by thread id - 1
+  enum JobState state;         // Protected by parse_lock
+  pthread_mutex_t parse_lock;  // Serializes parsing and the fields above
+};
+
+// Watch of a spool directory, in watch mode
+struct Watch {
+  char *dirpath;
+  int inotify_fd;
+  int signal_fd;     // Reports SIGCHLD, SIGINT and SIGTERM
+  sigset_t old_mask; // Signal mask before the watch, restored in children
+  list_t *seen;      // Jobs queued by the initial scan, with their
+                     // modification time as cost
+  int stopping;      // Set by SIGINT or SIGTERM
+};
+
+struct Worker {
+  struct Job *job;
+  unsigned int thread_id; // Starts at 1, as used by WAIT
+  pthread_t thread;
+  struct Stats stats; // Instrumentation of the current run of the thread
+};
+
+/// Checks whether a path ends with the given extension.
+/// @param filepath Path to be checked.
+/// @param extension Extension, including the dot.
+/// @return 1 if the path has the extension, 0 otherwise.
+static int has_extension(const char *filepath, const char *extension) {
+  size_t filepath_len = strlen(filepath);
+  size_t extension_len = strlen(extension);
+  return filepath_len > extension_len &&
+         strcmp(filepath + filepath_len - extension_len, extension) == 0;
+}
+
+/// Adds the stats file of every job that was started to a summary and prints
+/// it.
+/// @param stats_list Paths of the stats files.
+static void print_stats_summary(list_t *stats_list) {
+  struct Stats total;
+  stats_init(&total);
+
+  unsigned int jobs = 0;
+  for (node_t *node = stats_list->head; node != NULL; node = node->next) {
+    if (stats_read(&total, node->data) == 0) {
+      jobs++;
+    }
+  }
+
+  printf("---- Stats of %u jobs -------------------------------\n", jobs);
+  stats_print(&total, stdout);
+}
+
+/// Builds the path of a file in a directory.
+/// @param dirpath Path of the directory.
+/// @param filename Name of the file.
+/// @return Newly allocated path, NULL on failure.
+static char *dir_filepath(const char *dirpath, const char *filename) {
+  char *filepath = malloc(strlen(dirpath) + strlen(filename) + 2);
+  if (filepath == NULL) {
+    fprintf(stderr, "Error allocating memory for filepath\n");
+    return NULL;
+  }
+  sprintf(filepath, "%s/%s", dirpath, filename);
+  return filepath;
+}
+
+/// Gets the modification time of a file in nanoseconds.
+/// @param st Status of the file.
+/// @return Modification time.
+static long mtime_ns(const struct stat *st) {
+  return (long)st->st_mtim.tv_sec * 1000000000L + (long)st->st_mtim.tv_nsec;
+}
+
+/// Queues a job file, the size of the file being the estimate of its cost.
+/// @param job_queue Queue of jobs, sorted by decreasing cost.
+/// @param filepath Path of the job file.
+/// @param st Status of the job file.
+/// @return 0 if the job was queued successfully, 1 otherwise.
+static int queue_job(list_t *job_queue, char *filepath,
+                     const struct stat *st) {
+  const char *filename = strrchr(filepath, '/');
+  printf("----Filename: %s\t-------------------------------\n",
+         filename != NULL ? filename + 1 : filepath);
+
+  // Run the compiled job instead when it is up to date
+  char *jobc_filepath = change_extension(filepath, JOBC_FILE_EXTENSION);
+  const char *job_filepath =
+      jobc_filepath != NULL && jobc_is_fresh(filepath, jobc_filepath)
+          ? jobc_filepath
+          : filepath;
+
+  int result =
+      insert_sorted_linkedList(job_queue, (char *)job_filepath, st->st_size);
+  if (result) {
+    fprintf(stderr, "Failed to append file %s\n", filepath);
+  }
+  free(jobc_filepath);
+  return result;
+}
+
+/// Queues every job file of a directory.
+/// @param dirpath Path of the directory.
+/// @param job_queue Queue of jobs.
+/// @param seen List to add each queued job file to, with its modification
+/// time as cost, or NULL.
+/// @return 0 if the directory was read successfully, 1 otherwise.
+static int scan_dir(char *dirpath, list_t *job_queue, list_t *seen) {
+  DIR *dir = opendir(dirpath);
+
+  if (dir == NULL) {
+    fprintf(stderr, "Directory %s does not exists\n", dirpath);
+    return 1;
+  }
+
+  struct dirent *entry;
+  entry = readdir(dir);
+  while (entry) {
+
+    // check if file is .job terminated
+    if (has_extension(entry->d_name, JOB_FILE_EXTENSION)) {
+      char *filepath = dir_filepath(dirpath, entry->d_name);
+      if (filepath == NULL) {
+        closedir(dir);
+        return 1;
+      }
+
+      // read all regular files in the directory
+      struct stat st;
+      if (stat(filepath, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (queue_job(job_queue, filepath, &st) ||
+            (seen != NULL &&
+             insert_sorted_linkedList(seen, filepath, mtime_ns(&st)))) {
+          free(filepath);
+          closedir(dir);
+          return 1;
+        }
+      }
+      free(filepath);
+    }
+
+    entry = readdir(dir);
+  }
+  closedir(dir);
+  return 0;
+}
+
+/// Prints how a child process terminated.
+/// @param pid Process id of the child.
+/// @param status Status reported by waitpid.
+static void report_child(pid_t pid, int status) {
+  if (WIFEXITED(status)) {
+    printf("Child process %d terminated with status %d\n", pid,
+           WEXITSTATUS(status));
+  } else {
+    printf("Child process %d terminated abnormally\n", pid);
+  }
+}
+
+/// Starts watching a directory for new job files. SIGCHLD, SIGINT and
+/// SIGTERM are blocked and delivered through a descriptor instead, so that
+/// a single poll waits for new jobs and exited children alike.
+/// @param watch Watch to be initialized.
+/// @param dirpath Path of the directory.
+/// @return 0 if the watch was started successfully, 1 otherwise.
+static int watch_open(struct Watch *watch, char *dirpath) {
+  watch->dirpath = dirpath;
+  watch->stopping = 0;
+  watch->seen = create_linkedList();
+
+  watch->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch->inotify_fd == -1 ||
+      inotify_add_watch(watch->inotify_fd, dirpath,
+                        IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+    fprintf(stderr, "Failed to watch directory %s\n", dirpath);
+    if (watch->inotify_fd != -1) {
+      close(watch->inotify_fd);
+    }
+    free_linkedList(watch->seen);
+    return 1;
+  }
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGCHLD);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &signals, &watch->old_mask);
+  watch->signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (watch->signal_fd == -1) {
+    fprintf(stderr, "Failed to watch child processes\n");
+    sigprocmask(SIG_SETMASK, &watch->old_mask, NULL);
+    close(watch->inotify_fd);
+    free_linkedList(watch->seen);
+    return 1;
+  }
+  return 0;
+}
+
+/// Stops watching a directory. Also called in the children, so that jobs
+/// run with the original signal mask.
+/// @param watch Watch to be closed.
+static void watch_close(struct Watch *watch) {
+  close(watch->signal_fd);
+  close(watch->inotify_fd);
+  sigprocmask(SIG_SETMASK, &watch->old_mask, NULL);
+  free_linkedList(watch->seen);
+}
+
+/// Checks whether a job file was already queued by the initial scan.
+/// @param watch Watch of the directory.
+/// @param filepath Path of the job file.
+/// @param st Status of the job file.
+/// @return 1 if the same version of the file was queued, 0 otherwise.
+static int watch_seen(struct Watch *watch, const char *filepath,
+                      const struct stat *st) {
+  for (node_t *node = watch->seen->head; node != NULL; node = node->next) {
+    if (node->cost == mtime_ns(st) && strcmp(node->data, filepath) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/// Queues the job files reported by the watch.
+/// @param watch Watch of the directory.
+/// @param job_queue Queue of jobs.
+/// @return 0 on success, 1 otherwise.
+static int watch_read_jobs(struct Watch *watch, list_t *job_queue) {
+  _Alignas(struct inotify_event) char buffer[WATCH_BUFFER_SIZE];
+  while (1) {
+    ssize_t len = read(watch->inotify_fd, buffer, sizeof(buffer));
+    if (len <= 0) {
+      return 0; // drained
+    }
+
+    const struct inotify_event *event;
+    for (char *next = buffer; next < buffer + len;
+         next += sizeof(struct inotify_event) + event->len) {
+      event = (const struct inotify_event *)next;
+      if (event->mask & IN_Q_OVERFLOW) {
+        fprintf(stderr, "Watch queue overflowed, new jobs may be missed\n");
+      }
+      if (event->len == 0 ||
+          !has_extension(event->name, JOB_FILE_EXTENSION)) {
+        continue;
+      }
+
+      char *filepath = dir_filepath(watch->dirpath, event->name);
+      if (filepath == NULL) {
+        return 1;
+      }
+
+      // A file that landed while the directory was being scanned is
+      // reported by both, but must only run once
+      struct stat st;
+      int result = 0;
+      if (stat(filepath, &st) == 0 && S_ISREG(st.st_mode) &&
+          !watch_seen(watch, filepath, &st)) {
+        result = queue_job(job_queue, filepath, &st);
+      }
+      free(filepath);
+      if (result) {
+        return 1;
+      }
+    }
+  }
+}
+
+/// Waits until a new job is queued, a child exits or a stop is requested.
+/// @param watch Watch of the directory.
+/// @param job_queue Queue of jobs.
+/// @param running Number of running children, decremented as they exit.
+/// @return 0 on success, 1 otherwise.
+static int watch_wait(struct Watch *watch, list_t *job_queue,
+                      unsigned long int *running) {
+  struct pollfd fds[2] = {{watch->inotify_fd, POLLIN, 0},
+                          {watch->signal_fd, POLLIN, 0}};
+  if (poll(fds, 2, -1) == -1) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    fprintf(stderr, "Failed to wait for jobs\n");
+    return 1;
+  }
+
+  if (fds[1].revents & POLLIN) {
+    struct signalfd_siginfo info;
+    while (read(watch->signal_fd, &info, sizeof(info)) ==
+           (ssize_t)sizeof(info)) {
+      if (info.ssi_signo != SIGCHLD) {
+        watch->stopping = 1;
+      }
+    }
+
+    // Several exits may be reported by a single SIGCHLD
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      (*running)--;
+      report_child(pid, status);
+    }
+  }
+
+  if (!watch->stopping && (fds[0].revents & POLLIN)) {
+    return watch_read_jobs(watch, job_queue);
+  }
+  return 0;
+}
+
+/// Runs a job file on a fresh EMS state. Meant to be called in the child
+/// process of the job.
+/// @param filepath Path of the job file.
+/// @param delay_ms State access delay in milliseconds.
+/// @param max_threads Number of worker threads of the job.
+/// @param image_filepath Image to start the state from, may be NULL.
+/// @return Exit status of the child, 0 on success.
+static int run_job(char *filepath, unsigned int delay_ms,
+                   unsigned int max_threads, const char *image_filepath) {
+  if (image_filepath != NULL
+          ? ems_init_from_image(delay_ms, image_filepath)
+          : ems_init(delay_ms)) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    return 1;
+  }
+
+  int fd = open(filepath, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Failed to open job file %s\n", filepath);
+    ems_terminate();
+    return 1;
+  }
+
+  struct Stats stats;
+  stats_init(&stats);
+  int result = exec_file(fd, filepath, max_threads, &stats);
+  close(fd);
+
+  char *stats_filepath = change_extension(filepath, STATS_FILE_EXTENSION);
+  if (stats_filepath == NULL || stats_write(&stats, stats_filepath)) {
+    fprintf(stderr, "Failed to write stats of job %s\n", filepath);
+  }
+  free(stats_filepath);
+
+  if (ems_terminate()) {
+    return 1;
+  }
+  return result;
+}
+
+// ./ems [-s | -W] [-i image] [-w wal] <dir | register pipe>
+//       <max jobs | max sessions> <max threads> [delay]
 int main(int argc, char *argv[]) {
   unsigned int state_access_delay_ms = STATE_ACCESS_DELAY_MS;
+  int server_mode = 0;
+  int watch_mode = 0;
+  const char *image_filepath = NULL;
+  const char *wal_filepath = NULL;
+
+  int option;
+  opterr = 0; // reported below
+  while ((option = getopt(argc, argv, "sWi:w:")) != -1) {
+    switch (option) {
+    case 's':
+      server_mode = 1;
+      break;
+    case 'W':
+      watch_mode = 1;
+      break;
+    case 'i':
+      image_filepath = optarg;
+      break;
+    case 'w':
+      wal_filepath = optarg;
+      break;
+    default:
+      fprintf(stderr, "Invalid option\n");
+      return 1;
+    }
+  }
+
+  if (server_mode && watch_mode) {
+    fprintf(stderr, "Server and watch modes are exclusive\n");
+    return 1;
+  }
+
+  // Jobs run on states of their own, which are not worth logging
+  if (wal_filepath != NULL && !server_mode) {
+    fprintf(stderr, "A write-ahead log requires server mode\n");
+    return 1;
+  }
+
+  // Drop the options so the positional arguments keep their indexes
+  argc -= optind - 1;
+  argv += optind - 1;
 
   if (argc < NUM_MANDATORY_ARGS) {
     fprintf(stderr, "Invalid number of arguments\n");
@@ -36,169 +457,261 @@ int main(int argc, char *argv[]) {
     state_access_delay_ms = (unsigned int)delay;
   }
 
+  char *threads_endptr;
+  unsigned long int threads =
+      strtoul(argv[MAX_THREADS_ARG_INDEX], &threads_endptr, 10);
+
+  if (*threads_endptr != '\0' || threads == 0 || threads > UINT_MAX) {
+    fprintf(stderr, "Invalid number of threads\n");
+    return 1;
+  }
+
+  unsigned int max_threads = (unsigned int)threads;
+
+  char *endptr;
+  unsigned long int max_procs =
+      strtoul(argv[MAX_PROCS_ARG_INDEX], &endptr, 10);
+
+  if (*endptr != '\0' || max_procs == 0 || max_procs > INT_MAX) {
+    fprintf(stderr, server_mode ? "Invalid number of sessions\n"
+                                : "Invalid number of jobs\n");
+    return 1;
+  }
+
+  // A single resident EMS state serves every session, in this process
+  if (server_mode) {
+    return server_run(argv[REGISTER_PIPE_ARG_INDEX], (unsigned int)max_procs,
+                      max_threads, state_access_delay_ms, image_filepath,
+                      wal_filepath);
+  }
+
+  // In watch mode, the watch starts before the scan so that no job landing
+  // in between is missed, and the process keeps running until SIGINT or
+  // SIGTERM, starting new jobs as they land
   char *dirpath = argv[DIR_ARG_INDEX];
+  struct Watch watch;
+  if (watch_mode && watch_open(&watch, dirpath)) {
+    return 1;
+  }
+
   file_list = create_linkedList();
-  int ok = traverse_dir(dirpath, file_list);
+  int ok = scan_dir(dirpath, file_list, watch_mode ? watch.seen : NULL);
   if (ok) {
     fprintf(stderr, "Failed to traverse directory\n");
+    free_linkedList(file_list);
+    if (watch_mode) {
+      watch_close(&watch);
+    }
     return 1;
   }
 
-  char *endptr;
-  int max_procs = (int)strtoul(argv[MAX_PROCS_ARG_INDEX], &endptr, 10);
-  // Start child processes to execute the jobs up to MAX PROCS
-  while (file_list->size > 0) {
-    char *filepath = pop_linkedList(file_list);
-    if (filepath == NULL) {
-      fprintf(stderr, "Failed to pop filepath from list\n");
-      return 1;
-    }
+  // The list is sorted by decreasing cost, so the largest jobs start first
+  // and the small ones fill the gaps at the end. A new job is started as
+  // soon as any child exits, keeping max_procs children busy.
+  list_t *stats_list = create_linkedList();
+  unsigned long int running = 0;
+  int result = 0;
+  while (file_list->size > 0 || running > 0 ||
+         (watch_mode && !watch.stopping)) {
+    while (running < max_procs && file_list->size > 0) {
+      char *filepath = pop_linkedList(file_list);
+      if (filepath == NULL) {
+        fprintf(stderr, "Failed to pop filepath from list\n");
+        result = 1;
+        break;
+      }
 
-    if (max_procs == 0) {
-      wait(NULL);
-      max_procs++;
-    }
+      // Stats left by an earlier run must not be counted if the child fails
+      // before writing its own
+      char *stats_filepath = change_extension(filepath, STATS_FILE_EXTENSION);
+      if (stats_filepath != NULL && unlink(stats_filepath) != 0 &&
+          errno != ENOENT) {
+        fprintf(stderr, "Failed to remove stats of job %s\n", filepath);
+      }
 
-    max_procs--;
-    pid_t pid = fork();
-    if (pid == 0) {
-      if (ems_init(state_access_delay_ms)) {
-        fprintf(stderr, "Failed to initialize EMS\n");
-        exit(1);
+      fflush(stdout); // the child must not inherit pending output
+      pid_t pid = fork();
+      if (pid == -1) {
+        fprintf(stderr, "Failed to start job %s\n", filepath);
+        result = 1;
+      } else if (pid == 0) {
+        if (watch_mode) {
+          watch_close(&watch);
+        }
+        free_linkedList(file_list);
+        free_linkedList(stats_list);
+        free(stats_filepath);
+        int status = run_job(filepath, state_access_delay_ms, max_threads,
+                             image_filepath);
+        free(filepath);
+        exit(status);
+      } else {
+        running++;
+        if (stats_filepath == NULL ||
+            append_to_linkedList(stats_list, stats_filepath)) {
+          fprintf(stderr, "Failed to track stats of job %s\n", filepath);
+        }
       }
 
-      if (exec_file(open(filepath, O_RDONLY), filepath)) {
-        exit(1);
-      };
-      if (ems_terminate()) {
-        exit(1);
+      free(stats_filepath);
+      free(filepath);
+    }
+
+    if (watch_mode) {
+      if (watch_wait(&watch, file_list, &running)) {
+        result = 1;
+        break;
       }
-      exit(0);
+      // Once stopping, only the running jobs are waited for
+      if (watch.stopping) {
+        while (file_list->size > 0) {
+          free(pop_linkedList(file_list));
+        }
+      }
+      continue;
+    }
+
+    if (running == 0) {
+      break;
     }
 
-    free(filepath);
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid == -1) {
+      fprintf(stderr, "Failed to wait for child processes\n");
+      result = 1;
+      break;
+    }
+    running--;
+    report_child(pid, status);
   }
 
-  // wait for all child processes to finish
-  while (wait(NULL) > 0)
-    ;
+  if (watch_mode) {
+    watch_close(&watch);
+  }
+  print_stats_summary(stats_list);
+  free_linkedList(stats_list);
   free_linkedList(file_list);
 
-  return 0;
+  return result;
 }
 
 int traverse_dir(char *dirpath, list_t *fileList) {
-  DIR *dir = opendir(dirpath);
-
-  if (dir == NULL) {
-    fprintf(stderr, "Directory %s does not exists\n", dirpath);
-    return 1;
-  }
+  return scan_dir(dirpath, fileList, NULL);
+}
 
-  struct dirent *entry;
-  entry = readdir(dir);
-  while (entry) {
+/// Runs the commands of a job on one of its worker threads.
+/// Commands are parsed under the job's parse lock, which serializes access to
+/// the shared reader, and executed after releasing it.
+/// @param worker Worker of the thread.
+/// @param args Arguments buffer of the thread, reused by every command.
+static void exec_commands(struct Worker *worker, struct CommandArgs *args) {
+  struct Job *job = worker->job;
+  unsigned int delay;
 
-    // read all files in the directory
-    if (entry->d_type == DT_REG) {
-      // check if file is .job terminated
-      char *filename = entry->d_name;
-      printf("----Filename: %s\t-------------------------------\n", filename);
-      int filename_len = (int)strlen(filename);
+  while (1) {
+    uint64_t start = stats_now();
+    pthread_mutex_lock(&job->parse_lock);
+
+    // A WAIT may have been issued to this thread by any of the workers
+    delay = job->pending_waits[worker->thread_id - 1];
+    if (delay > 0) {
+      job->pending_waits[worker->thread_id - 1] = 0;
+      pthread_mutex_unlock(&job->parse_lock);
+      printf("Waiting...\n");
+      ems_wait(delay);
+      worker->stats.wait_ns += stats_now() - start;
+      continue;
+    }
 
-      if (filename_len > JOB_FILE_EXTENSION_LEN &&
-          strcmp(filename + filename_len - JOB_FILE_EXTENSION_LEN,
-                 JOB_FILE_EXTENSION) == 0) {
+    if (job->state != JOB_RUNNING) {
+      pthread_mutex_unlock(&job->parse_lock);
+      return;
+    }
 
-        char *filepath = malloc(strlen(dirpath) + strlen(entry->d_name) + 2);
-        if (filepath == NULL) {
-          fprintf(stderr, "Error allocating memory for filepath\n");
-          closedir(dir);
-          return 1;
-        }
-        sprintf(filepath, "%s/%s", dirpath, entry->d_name);
+    enum Command command;
+    int parse_error = job->compiled
+                          ? jobc_next(job->reader, &command, args)
+                          : parse_command(job->reader, &command, args);
+    if (job->jobc != NULL) {
+      jobc_writer_add(job->jobc, command, parse_error, args);
+    }
 
-        if (append_to_linkedList(fileList, filepath)) {
-          fprintf(stderr, "Failed to append file %s\n", filepath);
-          closedir(dir);
-          return 1;
+    if (!parse_error && command == CMD_WAIT) {
+      if (!args->has_thread_id) { // every thread waits
+        for (unsigned int i = 0; i < job->num_threads; i++) {
+          job->pending_waits[i] += args->delay;
         }
-        free(filepath);
+      } else if (args->thread_id < 1 || args->thread_id > job->num_threads) {
+        fprintf(stderr, "Invalid thread id %u\n", args->thread_id);
+      } else {
+        job->pending_waits[args->thread_id - 1] += args->delay;
       }
+    } else if (command == CMD_BARRIER) {
+      job->state = JOB_BARRIER;
+    } else if (command == EOC) {
+      job->state = JOB_FINISHED;
     }
 
-    entry = readdir(dir);
-  }
-  closedir(dir);
-  return 0;
-}
+    if (parse_error) {
+      job->state = JOB_FAILED;
+    }
+    pthread_mutex_unlock(&job->parse_lock);
 
-int exec_file(int fd, char *job_filepath) {
-  unsigned int event_id, delay;
-  size_t num_rows, num_columns, num_coords;
-  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+    uint64_t end = stats_now();
+    stats_record(&worker->stats.parse, end - start, 0);
+    start = end;
+    stats_take_delay();
+    int stop = 0;
 
-  while (1) {
+    if (parse_error) {
+      fprintf(stderr, "Invalid command. See HELP for usage\n");
+      return;
+    }
 
-    switch (get_next(fd)) {
+    switch (command) {
     case CMD_CREATE:
       printf("SWITCH cmd CREATE \n");
-      if (parse_create(fd, &event_id, &num_rows, &num_columns) != 0) {
-        fprintf(stderr, "Invalid command. See HELP for usage\n");
-        return 1;
-      }
-
-      if (ems_create(event_id, num_rows, num_columns)) {
+      if (ems_create(args->event_id, args->num_rows, args->num_cols)) {
         fprintf(stderr, "Failed to create event\n");
       }
-
       break;
 
     case CMD_RESERVE:
       printf("SWITCH cmd RESERVE \n");
-      num_coords = parse_reserve(fd, MAX_RESERVATION_SIZE, &event_id, xs, ys);
+      if (ems_reserve(args->event_id, args->num_coords, args->xs, args->ys)) {
+        fprintf(stderr, "Failed to reserve seats\n");
+      }
+      break;
 
-      if (num_coords == 0) {
-        fprintf(stderr, "Invalid command. See HELP for usage\n");
-        return 1;
+    case CMD_RESERVE_BEST:
+      if (ems_reserve_best(args->event_id, args->num_seats, job->out)) {
+        fprintf(stderr, "Failed to reserve seats\n");
       }
+      break;
 
-      if (ems_reserve(event_id, num_coords, xs, ys)) {
+    case CMD_TRANSACTION:
+      if (ems_transaction(args->num_coords, args->es, args->xs, args->ys)) {
         fprintf(stderr, "Failed to reserve seats\n");
       }
       break;
 
     case CMD_SHOW:
       printf("SWITCH cmd SHOW \n");
-      if (parse_show(fd, &event_id) != 0) {
-        fprintf(stderr, "Invalid command. See HELP for usage\n");
-        return 1;
-      }
-      if (ems_show(event_id, job_filepath)) {
+      if (ems_show(args->event_id, job->out)) {
         fprintf(stderr, "Failed to show event\n");
       }
-
       break;
 
     case CMD_LIST_EVENTS:
       printf("SWITCH cmd LIST \n");
-      if (ems_list_events(job_filepath)) {
+      if (ems_list_events(job->out)) {
         fprintf(stderr, "Failed to list events\n");
       }
       break;
 
     case CMD_WAIT:
       printf("SWITCH cmd WAIT \n");
-      if (parse_wait(fd, &delay, NULL) == -1) { // thread_id is not implemented
-        fprintf(stderr, "Invalid command. See HELP for usage\n");
-        return 1;
-      }
-
-      if (delay > 0) {
-        printf("Waiting...\n");
-        ems_wait(delay);
-      }
-
       break;
 
     case CMD_INVALID:
@@ -207,23 +720,173 @@ int exec_file(int fd, char *job_filepath) {
       break;
 
     case CMD_HELP:
-      if (ems_help(job_filepath)) {
+      if (ems_help(job->out)) {
         fprintf(stderr, "Failed to list events\n");
       }
+      break;
 
+    case CMD_BARRIER:
+      stop = 1;
       break;
 
-    case CMD_BARRIER: // Not implemented
     case CMD_EMPTY:
       break;
 
     case EOC:
       printf("SWITCH cmd EOC \n");
-      return 0;
+      stop = 1;
+      break;
+    }
 
-    default:
-      fprintf(stderr, "Invalid command. See HELP for usage\n");
-      return 1;
+    // A client waiting on a session gets each response as soon as it is
+    // ready
+    if (job->interactive && command != CMD_EMPTY && output_flush(job->out)) {
+      fprintf(stderr, "Failed to write output\n");
+    }
+
+    stats_record(&worker->stats.commands[command], stats_now() - start,
+                 stats_take_delay());
+    if (stop) {
+      return;
+    }
+  }
+}
+
+/// Entry point of the worker threads of a job.
+/// @param arg Pointer to the struct Worker of the thread.
+/// @return NULL.
+static void *exec_worker(void *arg) {
+  struct Worker *worker = (struct Worker *)arg;
+  struct CommandArgs args;
+  if (command_args_init(&args)) {
+    pthread_mutex_lock(&worker->job->parse_lock);
+    worker->job->state = JOB_FAILED;
+    pthread_mutex_unlock(&worker->job->parse_lock);
+    return NULL;
+  }
+
+  exec_commands(worker, &args);
+  command_args_destroy(&args);
+  return NULL;
+}
+
+int exec_file(int fd, char *job_filepath, unsigned int max_threads,
+              struct Stats *stats) {
+  struct Reader reader;
+  if (reader_init(&reader, fd)) {
+    fprintf(stderr, "Failed to open job file %s\n", job_filepath);
+    return 1;
+  }
+
+  struct Output out;
+  if (output_open(&out, job_filepath)) {
+    reader_destroy(&reader);
+    return 1;
+  }
+
+  // Text jobs are compiled while they run, so that later runs of the same
+  // job can skip parsing
+  struct JobcWriter writer;
+  struct JobcWriter *jobc = NULL;
+  if (has_extension(job_filepath, JOB_FILE_EXTENSION)) {
+    char *jobc_filepath = change_extension(job_filepath, JOBC_FILE_EXTENSION);
+    if (jobc_filepath != NULL &&
+        jobc_writer_open(&writer, fd, jobc_filepath) == 0) {
+      jobc = &writer;
     }
+    free(jobc_filepath);
+  }
+
+  int compiled = has_extension(job_filepath, JOBC_FILE_EXTENSION);
+  int result = compiled && jobc_read_header(&reader);
+  if (!result) {
+    result =
+        exec_stream(&reader, &out, compiled, 0, max_threads, jobc, stats);
+  }
+  if (jobc != NULL) {
+    jobc_writer_close(jobc);
   }
+
+  if (output_close(&out)) {
+    fprintf(stderr, "Failed to write output\n");
+    result = 1;
+  }
+  reader_destroy(&reader);
+  return result;
+}
+
+int exec_stream(struct Reader *reader, struct Output *out, int compiled,
+                int interactive, unsigned int max_threads,
+                struct JobcWriter *jobc, struct Stats *stats) {
+  uint64_t job_start = stats_now();
+
+  struct Job job;
+  job.reader = reader;
+  job.out = out;
+  job.compiled = compiled;
+  job.interactive = interactive;
+  job.jobc = jobc;
+
+  // Changes are made durable before any output that reports them, whether
+  // it is written at a barrier or because the buffer filled up
+  out->before_write = ems_sync;
+  job.num_threads = max_threads > 0 ? max_threads : 1;
+  job.state = JOB_RUNNING;
+  job.pending_waits = calloc(job.num_threads, sizeof(unsigned int));
+  struct Worker *workers = malloc(job.num_threads * sizeof(struct Worker));
+  if (job.pending_waits == NULL || workers == NULL) {
+    fprintf(stderr, "Error allocating memory for job threads\n");
+    free(job.pending_waits);
+    free(workers);
+    return 1;
+  }
+  pthread_mutex_init(&job.parse_lock, NULL);
+
+  // Every BARRIER stops all the workers; they are joined and started again
+  // so that no command after the barrier overlaps with one before it.
+  while (job.state == JOB_RUNNING) {
+    unsigned int started = 0;
+    for (; started < job.num_threads; started++) {
+      workers[started].job = &job;
+      workers[started].thread_id = started + 1;
+      stats_init(&workers[started].stats);
+      if (pthread_create(&workers[started].thread, NULL, exec_worker,
+                         &workers[started]) != 0) {
+        fprintf(stderr, "Failed to create thread\n");
+        pthread_mutex_lock(&job.parse_lock);
+        job.state = JOB_FAILED;
+        pthread_mutex_unlock(&job.parse_lock);
+        break;
+      }
+    }
+
+    for (unsigned int i = 0; i < started; i++) {
+      pthread_join(workers[i].thread, NULL);
+      if (stats != NULL) {
+        stats_merge(stats, &workers[i].stats);
+      }
+    }
+
+    // The reservations before a barrier are durable once it is passed, even
+    // when they left no output to flush
+    if (job.state == JOB_BARRIER) {
+      job.state = JOB_RUNNING;
+      if (ems_sync()) {
+        fprintf(stderr, "Failed to sync write-ahead log\n");
+      }
+      if (output_flush(out)) {
+        fprintf(stderr, "Failed to write output\n");
+      }
+    }
+  }
+
+  if (stats != NULL) {
+    stats->wall_ns += stats_now() - job_start;
+  }
+
+  int result = job.state == JOB_FAILED;
+  pthread_mutex_destroy(&job.parse_lock);
+  free(job.pending_waits);
+  free(workers);
+  return result;
 }
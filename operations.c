@@ -1,16 +1,38 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "auxiliar_functions.h"
+#include "constants.h"
 #include "eventlist.h"
+#include "image.h"
 #include "operations.h"
+#include "output.h"
+#include "stats.h"
+#include "wal.h"
 
 static struct EventList *event_list = NULL;
 static unsigned int state_access_delay_ms = 0;
 
+// Mapping of the image the state was restored from, if any. The seats of the
+// restored events live in it until the state is destroyed.
+static void *image_map = NULL;
+static size_t image_map_len = 0;
+
+// Write-ahead log of the changes to the state, if one is attached
+static struct Wal wal;
+static int wal_attached = 0;
+
+// Serializes the changes to the structure of the event list, which only
+// CREATE makes. Lookups and LIST read the list without any lock; the seats of
+// each event are guarded by the event's own lock.
+static pthread_mutex_t create_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /// Calculates a timespec from a delay in milliseconds.
 /// @param delay_ms Delay in milliseconds.
 /// @return Timespec with the given delay.
@@ -18,31 +40,59 @@ static struct timespec delay_to_timespec(unsigned int delay_ms) {
   return (struct timespec){delay_ms / 1000, (delay_ms % 1000) * 1000000};
 }
 
+/// Sleeps for the state access delay, accounting the time slept to the
+/// calling thread.
+static void state_access_sleep(void) {
+  struct timespec delay = delay_to_timespec(state_access_delay_ms);
+  uint64_t start = stats_now();
+  nanosleep(&delay, NULL); // Should not be removed
+  stats_add_delay(stats_now() - start);
+}
+
 /// Gets the event with the given ID from the state.
 /// @note Will wait to simulate a real system accessing a costly memory
 /// resource.
 /// @param event_id The ID of the event to get.
 /// @return Pointer to the event if found, NULL otherwise.
 static struct Event *get_event_with_delay(unsigned int event_id) {
-  struct timespec delay = delay_to_timespec(state_access_delay_ms);
-  nanosleep(&delay, NULL); // Should not be removed
+  state_access_sleep();
 
   return get_event(event_list, event_id);
 }
 
-/// Gets the seat with the given index from the state.
+/// Gets the span of contiguous seats from the given index to the end of its
+/// row from the state.
 /// @note Will wait to simulate a real system accessing a costly memory
-/// resource.
-/// @param event Event to get the seat from.
-/// @param index Index of the seat to get.
-/// @return Pointer to the seat.
-static unsigned int *get_seat_with_delay(struct Event *event, size_t index) {
-  struct timespec delay = delay_to_timespec(state_access_delay_ms);
-  nanosleep(&delay, NULL); // Should not be removed
+/// resource. The whole span is transferred in a single access.
+/// @param event Event to get the seats from.
+/// @param index Index of the first seat of the span.
+/// @return Pointer to the first seat of the span.
+static unsigned int *get_seat_span_with_delay(struct Event *event,
+                                              size_t index) {
+  state_access_sleep();
 
   return &event->data[index];
 }
 
+/// Gets a batch of seats, given by their indexes, from the state.
+/// @note Will wait to simulate a real system accessing a costly memory
+/// resource. The whole batch is transferred in a single access, so only the
+/// seats in indexes may be accessed through the returned pointer.
+/// @param event Event to get the seats from.
+/// @param indexes Indexes of the seats in the batch.
+/// @param num_seats Number of seats in the batch.
+/// @return Pointer to the seats of the event, to be indexed by indexes.
+static unsigned int *get_seat_batch_with_delay(struct Event *event,
+                                               const size_t *indexes,
+                                               size_t num_seats) {
+  (void)indexes;
+  (void)num_seats;
+
+  state_access_sleep();
+
+  return event->data;
+}
+
 /// Gets the index of a seat.
 /// @note This function assumes that the seat exists.
 /// @param event Event to get the seat index from.
@@ -53,6 +103,56 @@ static size_t seat_index(struct Event *event, size_t row, size_t col) {
   return (row - 1) * event->cols + col - 1;
 }
 
+/// Orders seat indexes for qsort.
+/// @param a Pointer to the first index.
+/// @param b Pointer to the second index.
+/// @return Negative, zero or positive as a is below, equal to or above b.
+static int compare_indexes(const void *a, const void *b) {
+  size_t x = *(const size_t *)a;
+  size_t y = *(const size_t *)b;
+  return (x > y) - (x < y);
+}
+
+/// Seat of a transaction.
+struct TransactionSeat {
+  size_t event_id;
+  size_t row;
+  size_t col;
+};
+
+/// Event of a transaction, along with the indexes of its seats.
+struct TransactionPart {
+  struct Event *event;
+  size_t *indexes; /// Ascending indexes of the seats.
+  size_t num_seats;
+  unsigned int *data; /// Seats of the event, fetched before locking.
+};
+
+/// Orders the seats of a transaction by event and then by position for qsort.
+/// @param a Pointer to the first seat.
+/// @param b Pointer to the second seat.
+/// @return Negative, zero or positive as a goes before, with or after b.
+static int compare_transaction_seats(const void *a, const void *b) {
+  const struct TransactionSeat *x = a;
+  const struct TransactionSeat *y = b;
+  if (x->event_id != y->event_id) {
+    return (x->event_id > y->event_id) - (x->event_id < y->event_id);
+  }
+  if (x->row != y->row) {
+    return (x->row > y->row) - (x->row < y->row);
+  }
+  return (x->col > y->col) - (x->col < y->col);
+}
+
+/// Frees the seat indexes of a reservation, unless they are on the stack.
+/// @param indexes Seat indexes.
+/// @param stack_indexes Stack buffer of the reservation.
+static void free_indexes(size_t *indexes, size_t *stack_indexes) {
+  if (indexes != stack_indexes) {
+    free(indexes);
+  }
+}
+
 int ems_init(unsigned int delay_ms) {
   if (event_list != NULL) {
     fprintf(stderr, "EMS state has already been initialized\n");
@@ -65,14 +165,132 @@ int ems_init(unsigned int delay_ms) {
   return event_list == NULL;
 }
 
+int ems_init_from_image(unsigned int delay_ms, const char *image_filepath) {
+  if (ems_init(delay_ms)) {
+    return 1;
+  }
+
+  if (image_load(event_list, image_filepath, &image_map, &image_map_len)) {
+    free_list(event_list);
+    event_list = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+int ems_snapshot(const char *image_filepath) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  pthread_mutex_lock(&create_lock);
+  int result = image_write(event_list, image_filepath);
+  pthread_mutex_unlock(&create_lock);
+
+  // Everything logged so far is in the image now
+  if (result == 0 && wal_attached) {
+    result = wal_truncate(&wal);
+  }
+  return result;
+}
+
+/// Applies the records of a write-ahead log to the state.
+/// @note Records whose changes are already in the state, because they were
+/// saved in the image it was restored from, fail and change nothing.
+/// @param reader Reader positioned after the header of the log.
+/// @param valid_len Where the length of the valid part of the log is stored.
+/// @return 0 if the log was replayed, 1 if memory ran out.
+static int replay_wal(struct Reader *reader, size_t *valid_len) {
+  struct CommandArgs args;
+  if (command_args_init(&args)) {
+    return 1;
+  }
+
+  // Replay is not a costly access by clients, so it is not delayed
+  unsigned int delay_ms = state_access_delay_ms;
+  state_access_delay_ms = 0;
+  struct WalRecord record;
+  *valid_len = sizeof(struct WalHeader);
+  while (wal_next(reader, &record, &args, valid_len) == 0) {
+    if (record.type == WAL_CREATE) {
+      ems_create(record.event_id, record.arg0, record.arg1);
+    } else if (record.type == WAL_TRANSACTION) {
+      ems_transaction(args.num_coords, args.es, args.xs, args.ys);
+    } else {
+      ems_reserve(record.event_id, args.num_coords, args.xs, args.ys);
+    }
+  }
+  state_access_delay_ms = delay_ms;
+
+  command_args_destroy(&args);
+  return 0;
+}
+
+int ems_attach_wal(const char *wal_filepath) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+  if (wal_attached) {
+    fprintf(stderr, "A write-ahead log is already attached\n");
+    return 1;
+  }
+
+  size_t valid_len = 0;
+  int fd = open(wal_filepath, O_RDONLY);
+  if (fd != -1) {
+    struct stat st;
+    struct Reader reader;
+    if (fstat(fd, &st) != 0 || reader_init(&reader, fd) != 0) {
+      fprintf(stderr, "Error reading file %s\n", wal_filepath);
+      close(fd);
+      return 1;
+    }
+
+    int result = 0;
+    if (st.st_size > 0) {
+      result = wal_read_header(&reader);
+      if (result == 0) {
+        result = replay_wal(&reader, &valid_len);
+      }
+    }
+    reader_destroy(&reader);
+    close(fd);
+    if (result) {
+      return 1;
+    }
+  }
+
+  if (wal_open(&wal, wal_filepath, valid_len)) {
+    return 1;
+  }
+  wal_attached = 1;
+  return 0;
+}
+
+int ems_sync() { return wal_attached ? wal_sync(&wal) : 0; }
+
 int ems_terminate() {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
+  int result = 0;
+  if (wal_attached) {
+    result = wal_close(&wal);
+    wal_attached = 0;
+  }
+
   free_list(event_list);
   event_list = NULL;
-  return 0;
+
+  if (image_map != NULL) {
+    munmap(image_map, image_map_len);
+    image_map = NULL;
+    image_map_len = 0;
+  }
+  return result;
 }
 
 // Creates a new event.
@@ -87,37 +305,47 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
     return 1;
   }
 
-  struct Event *event = malloc(sizeof(struct Event));
+  pthread_mutex_lock(&create_lock);
 
-  if (event == NULL) {
-    fprintf(stderr, "Error allocating memory for event\n");
+  // Another thread may have created the same event since the lookup above.
+  // Arena memory is never freed, so the event is only allocated once it is
+  // known to be new.
+  if (get_event(event_list, event_id) != NULL) {
+    pthread_mutex_unlock(&create_lock);
+    fprintf(stderr, "Event already exists\n");
     return 1;
   }
 
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  event->data = malloc(num_rows * num_cols * sizeof(unsigned int));
+  struct Event *event = new_event(event_list, event_id, num_rows, num_cols);
 
-  if (event->data == NULL) {
-    fprintf(stderr, "Error allocating memory for event data\n");
-    free(event);
+  if (event == NULL) {
+    pthread_mutex_unlock(&create_lock);
+    fprintf(stderr, "Error allocating memory for event\n");
     return 1;
   }
 
-  for (size_t i = 0; i < num_rows * num_cols; i++) {
-    event->data[i] = 0;
-  }
+  // Lookups find the event as soon as it is appended. Holding its lock until
+  // the creation is logged keeps its reservations from being logged first.
+  pthread_rwlock_wrlock(&event->lock);
 
   if (append_to_list(event_list, event) != 0) {
+    pthread_rwlock_unlock(&event->lock);
+    pthread_mutex_unlock(&create_lock);
     fprintf(stderr, "Error appending event to list\n");
-    free(event->data);
-    free(event);
     return 1;
   }
 
-  return 0;
+  // Logged under the create lock too, so replay appends the events in the
+  // same order
+  int result = wal_attached && wal_log_create(&wal, event_id, num_rows,
+                                              num_cols) != 0;
+  pthread_rwlock_unlock(&event->lock);
+  pthread_mutex_unlock(&create_lock);
+
+  if (result) {
+    fprintf(stderr, "Failed to log event\n");
+  }
+  return result;
 }
 
 // Reserves seats for an event.
@@ -135,184 +363,373 @@ int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs,
     return 1;
   }
 
-  unsigned int reservation_id = ++event->reservations;
+  // Common reservations are indexed on the stack, large ones on the heap
+  size_t stack_indexes[INITIAL_RESERVATION_SIZE];
+  size_t *indexes = stack_indexes;
+  if (num_seats > INITIAL_RESERVATION_SIZE) {
+    indexes = malloc(num_seats * sizeof(size_t));
+    if (indexes == NULL) {
+      fprintf(stderr, "Error allocating memory for reservation\n");
+      return 1;
+    }
+  }
 
-  size_t i = 0;
-  for (; i < num_seats; i++) {
+  for (size_t i = 0; i < num_seats; i++) {
     size_t row = xs[i];
     size_t col = ys[i];
 
     if (row <= 0 || row > event->rows || col <= 0 || col > event->cols) {
       fprintf(stderr, "Invalid seat\n");
-      break;
+      free_indexes(indexes, stack_indexes);
+      return 1;
     }
+    indexes[i] = seat_index(event, row, col);
+  }
 
-    if (*get_seat_with_delay(event, seat_index(event, row, col)) != 0) {
-      fprintf(stderr, "Seat already reserved\n");
-      break;
+  // Sorted, the seats are claimed a bitmap word at a time and written in
+  // order, and repeated seats end up next to each other. All of it happens
+  // before the event is locked.
+  qsort(indexes, num_seats, sizeof(size_t), compare_indexes);
+  for (size_t i = 1; i < num_seats; i++) {
+    if (indexes[i] == indexes[i - 1]) {
+      fprintf(stderr, "Repeated seat\n");
+      free_indexes(indexes, stack_indexes);
+      return 1;
     }
-
-    *get_seat_with_delay(event, seat_index(event, row, col)) = reservation_id;
   }
 
-  // If the reservation was not successful, free the seats that were reserved.
-  if (i < num_seats) {
-    event->reservations--;
-    for (size_t j = 0; j < i; j++) {
-      *get_seat_with_delay(event, seat_index(event, xs[j], ys[j])) = 0;
-    }
+  // The seats are checked and fetched without the lock, so the costly
+  // access never blocks other reservations or SHOWs of the event. Only the
+  // words of the bitmap that cover them are checked again under the lock,
+  // and seats claimed meanwhile elsewhere in the event do not matter.
+  if (!seats_free(event, indexes, num_seats)) {
+    fprintf(stderr, "Seat already reserved\n");
+    free_indexes(indexes, stack_indexes);
     return 1;
   }
+  unsigned int *seats = get_seat_batch_with_delay(event, indexes, num_seats);
 
-  return 0;
-}
+  pthread_rwlock_wrlock(&event->lock);
 
-int ems_show(unsigned int event_id, char *job_filepath) {
-  if (event_list == NULL) {
-    fprintf(stderr, "EMS state must be initialized\n");
+  // Conflicts are caught on the occupancy bitmap, so a failing reservation
+  // never touches the seats themselves.
+  if (claim_seats(event, indexes, num_seats) != 0) {
+    fprintf(stderr, "Seat already reserved\n");
+    pthread_rwlock_unlock(&event->lock);
+    free_indexes(indexes, stack_indexes);
     return 1;
   }
 
-  struct Event *event = get_event_with_delay(event_id);
+  unsigned int reservation_id = ++event->reservations;
 
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
-    return 1;
+  for (size_t i = 0; i < num_seats; i++) {
+    seats[indexes[i]] = reservation_id;
   }
 
-  char *out_file_path = generate_filepath(job_filepath);
-  if (out_file_path == NULL) {
-    fprintf(stderr, "Error generating filepath\n");
+  // Logged under the event lock, so replay assigns the same reservation ids
+  if (wal_attached &&
+      wal_log_reserve(&wal, event_id, num_seats, xs, ys) != 0) {
+    pthread_rwlock_unlock(&event->lock);
+    fprintf(stderr, "Failed to log reservation\n");
+    free_indexes(indexes, stack_indexes);
     return 1;
   }
-  int out_file = open(out_file_path, O_CREAT | O_WRONLY | O_APPEND,
-                      0666); // FIXME: what file permission number to use
-  if (out_file == -1) {
-    fprintf(stderr, "Error opening file\n");
-    return 1;
+
+  pthread_rwlock_unlock(&event->lock);
+  free_indexes(indexes, stack_indexes);
+  return 0;
+}
+
+/// Unlocks the events of a transaction, in the reverse order they were
+/// locked.
+/// @param parts Events of the transaction.
+/// @param num_parts Number of events locked.
+static void unlock_transaction(struct TransactionPart *parts,
+                               size_t num_parts) {
+  while (num_parts > 0) {
+    pthread_rwlock_unlock(&parts[--num_parts].event->lock);
   }
+}
 
-  unsigned long buffer_size = (event->rows * event->cols * 2) + 1;
-  char buffer[buffer_size];
-  unsigned long number_chars_written = 0;
-  int written_len;
+// Reserves seats across several events.
+int ems_transaction(size_t num_seats, size_t *es, size_t *xs, size_t *ys) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
 
-  memset(buffer, '\0', buffer_size);
+  // The seats, their indexes and the events share a single allocation
+  size_t seats_len = num_seats * sizeof(struct TransactionSeat);
+  size_t indexes_len = num_seats * sizeof(size_t);
+  char *memory = malloc(seats_len + indexes_len +
+                        num_seats * sizeof(struct TransactionPart));
+  if (memory == NULL) {
+    fprintf(stderr, "Error allocating memory for transaction\n");
+    return 1;
+  }
+  struct TransactionSeat *seats = (struct TransactionSeat *)memory;
+  size_t *indexes = (size_t *)(memory + seats_len);
+  struct TransactionPart *parts =
+      (struct TransactionPart *)(memory + seats_len + indexes_len);
 
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      unsigned int *seat = get_seat_with_delay(event, seat_index(event, i, j));
+  for (size_t i = 0; i < num_seats; i++) {
+    seats[i] = (struct TransactionSeat){es[i], xs[i], ys[i]};
+  }
 
-      written_len = snprintf(buffer + number_chars_written,
-                             buffer_size - number_chars_written, "%d", *seat);
-      if (written_len != 1) {
-        fprintf(stderr, "Error writing to buffer\n");
+  // Sorted, the seats of each event are contiguous and in ascending order,
+  // and the events are in the order they are locked in
+  qsort(seats, num_seats, sizeof(struct TransactionSeat),
+        compare_transaction_seats);
+
+  size_t num_parts = 0;
+  struct TransactionPart *part = NULL;
+  for (size_t i = 0; i < num_seats; i++) {
+    if (i == 0 || seats[i].event_id != seats[i - 1].event_id) {
+      part = &parts[num_parts++];
+      part->event = get_event_with_delay((unsigned int)seats[i].event_id);
+      part->indexes = &indexes[i];
+      part->num_seats = 0;
+      if (part->event == NULL) {
+        fprintf(stderr, "Event not found\n");
+        free(memory);
         return 1;
       }
-      ++number_chars_written;
-
-      if (j < event->cols) {
-        written_len = snprintf(buffer + number_chars_written,
-                               buffer_size - number_chars_written, "%s", " ");
-        if (written_len != 1) {
-          fprintf(stderr, "Error writing to buffer\n");
-          return 1;
-        }
-        ++number_chars_written;
-      }
     }
-    written_len = snprintf(buffer + number_chars_written,
-                           buffer_size - number_chars_written, "%s", "\n");
-    if (written_len != 1) {
-      fprintf(stderr, "Error writing to buffer\n");
+
+    struct Event *event = part->event;
+    size_t row = seats[i].row;
+    size_t col = seats[i].col;
+    if (row <= 0 || row > event->rows || col <= 0 || col > event->cols) {
+      fprintf(stderr, "Invalid seat\n");
+      free(memory);
       return 1;
     }
-    ++number_chars_written;
-  }
-  ssize_t bytes_written =
-      write(out_file, buffer, buffer_size - 1); // remove null terminator
-  int check_bytes = check_bytes_written(out_file, buffer, bytes_written,
-                                        (ssize_t)buffer_size - 1);
-  printf("LOOK bytes_written: %zd\n", bytes_written);
-  close(out_file);
-  if (check_bytes == 1) {
-    return 1;
+    indexes[i] = seat_index(event, row, col);
+    if (part->num_seats > 0 && indexes[i] == indexes[i - 1]) {
+      fprintf(stderr, "Repeated seat\n");
+      free(memory);
+      return 1;
+    }
+    part->num_seats++;
   }
-  return 0;
+
+  // The seats of every event are fetched before any event is locked, so the
+  // costly accesses never hold up other reservations. Under the locks, only
+  // the bitmap is checked and the seats written.
+  for (size_t i = 0; i < num_parts; i++) {
+    part = &parts[i];
+    part->data = get_seat_batch_with_delay(part->event, part->indexes,
+                                           part->num_seats);
+  }
+
+  // Every event is locked and every seat checked before any is claimed, so
+  // a failing transaction has nothing to roll back
+  for (size_t i = 0; i < num_parts; i++) {
+    pthread_rwlock_wrlock(&parts[i].event->lock);
+  }
+  for (size_t i = 0; i < num_parts; i++) {
+    if (!seats_free(parts[i].event, parts[i].indexes, parts[i].num_seats)) {
+      unlock_transaction(parts, num_parts);
+      fprintf(stderr, "Seat already reserved\n");
+      free(memory);
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < num_parts; i++) {
+    part = &parts[i];
+    claim_seats(part->event, part->indexes, part->num_seats);
+    unsigned int reservation_id = ++part->event->reservations;
+    for (size_t j = 0; j < part->num_seats; j++) {
+      part->data[part->indexes[j]] = reservation_id;
+    }
+  }
+
+  // Logged as a single record under every event lock, so replay applies the
+  // transaction whole and in the same order as the reservations around it
+  int result =
+      wal_attached && wal_log_transaction(&wal, num_seats, es, xs, ys) != 0;
+  unlock_transaction(parts, num_parts);
+  free(memory);
+
+  if (result) {
+    fprintf(stderr, "Failed to log reservation\n");
+  }
+  return result;
 }
 
-int ems_list_events(char *job_filepath) {
+// Reserves the best run of seats for an event.
+int ems_reserve_best(unsigned int event_id, size_t num_seats,
+                     struct Output *out) {
   if (event_list == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  char *out_file_path = generate_filepath(job_filepath);
-  if (out_file_path == NULL) {
-    fprintf(stderr, "Error generating filepath\n");
+  struct Event *event = get_event_with_delay(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
     return 1;
   }
-  int out_file = open(out_file_path, O_CREAT | O_WRONLY | O_APPEND,
-                      0666); // FIXME: what file permission number to use
-  if (out_file == -1) {
-    fprintf(stderr, "Error opening file\n");
+
+  if (num_seats == 0 || num_seats > event->cols) {
+    fprintf(stderr, "Invalid number of seats\n");
     return 1;
   }
 
-  ssize_t bytes_written;
+  // The log takes the run as the coordinates of a plain reservation, so
+  // replay needs no index
+  size_t stack_coords[2 * INITIAL_RESERVATION_SIZE];
+  size_t *xs = stack_coords;
+  if (wal_attached && num_seats > INITIAL_RESERVATION_SIZE) {
+    xs = malloc(2 * num_seats * sizeof(size_t));
+    if (xs == NULL) {
+      fprintf(stderr, "Error allocating memory for reservation\n");
+      return 1;
+    }
+  }
 
-  if (event_list->head == NULL) {
+  pthread_rwlock_wrlock(&event->lock);
+
+  // The index is only built for events that take a RESERVE_BEST, and from
+  // then on every reservation keeps it up to date
+  if (index_free_runs(event_list, event) != 0) {
+    pthread_rwlock_unlock(&event->lock);
+    fprintf(stderr, "Error allocating memory for seat index\n");
+    free_indexes(xs, stack_coords);
+    return 1;
+  }
 
-    char buffer[NO_EVENTS_BUFFER_SIZE];
-    memset(buffer, '\0', NO_EVENTS_BUFFER_SIZE);
-    strcpy(buffer, "No events\n");
+  size_t first;
+  if (free_runs_find(event->free_runs, num_seats, &first) != 0) {
+    pthread_rwlock_unlock(&event->lock);
+    fprintf(stderr, "No contiguous seats available\n");
+    free_indexes(xs, stack_coords);
+    return 1;
+  }
+
+  claim_run(event, first, num_seats);
+  unsigned int reservation_id = ++event->reservations;
+
+  unsigned int *seats = get_seat_span_with_delay(event, first);
+  for (size_t i = 0; i < num_seats; i++) {
+    seats[i] = reservation_id;
+  }
 
-    bytes_written = write(out_file, buffer,
-                          NO_EVENTS_BUFFER_SIZE - 1); // remove null terminator
-    int check_bytes = check_bytes_written(out_file, buffer, bytes_written,
-                                          (ssize_t)NO_EVENTS_BUFFER_SIZE - 1);
-    if (check_bytes == 1) {
-      close(out_file);
+  size_t row = first / event->cols + 1;
+  size_t col = first % event->cols + 1;
+  if (wal_attached) {
+    size_t *ys = xs + num_seats;
+    for (size_t i = 0; i < num_seats; i++) {
+      xs[i] = row;
+      ys[i] = col + i;
+    }
+    if (wal_log_reserve(&wal, event_id, num_seats, xs, ys) != 0) {
+      pthread_rwlock_unlock(&event->lock);
+      fprintf(stderr, "Failed to log reservation\n");
+      free_indexes(xs, stack_coords);
       return 1;
     }
+  }
 
-  } else {
+  pthread_rwlock_unlock(&event->lock);
+  free_indexes(xs, stack_coords);
+
+  char line[3 * (UINT_MAX_DIGITS + 1)];
+  size_t len = format_uint(line, (unsigned int)row);
+  line[len++] = ' ';
+  len += format_uint(line + len, (unsigned int)col);
+  line[len++] = ' ';
+  len += format_uint(line + len, (unsigned int)(col + num_seats - 1));
+  line[len++] = '\n';
+  return output_write(out, line, len);
+}
 
-    int written_len;
-    char buffer[EVENT_LIST_BUFFER_SIZE];
-    memset(buffer, '\0', EVENT_LIST_BUFFER_SIZE);
+/// Writes the seats of an event to the output of a job.
+/// Rows are emitted from the SHOW cache of the event, and only the rows
+/// reserved since the last SHOW are fetched and rendered again. They are
+/// refreshed before the output is locked, so it is never held while seats
+/// are being fetched.
+/// @note The caller must hold the event lock.
+/// @param event Event to be written.
+/// @param out Output of the job.
+/// @return 0 if the event was written successfully, 1 otherwise.
+static int write_event(struct Event *event, struct Output *out) {
+  pthread_mutex_lock(&event->show_lock);
+
+  if (event->show_cache == NULL) {
+    event->show_cache = show_cache_create(event->rows);
+    if (event->show_cache == NULL) {
+      pthread_mutex_unlock(&event->show_lock);
+      fprintf(stderr, "Error allocating memory for event rendering\n");
+      return 1;
+    }
+  }
+  struct ShowCache *cache = event->show_cache;
 
-    struct ListNode *current = event_list->head;
-    while (current != NULL) {
+  for (size_t i = 0; i < event->rows; i++) {
+    if (!show_cache_is_dirty(cache, i)) {
+      continue;
+    }
 
-      written_len = snprintf(buffer, EVENT_LIST_BUFFER_SIZE, "Event: ");
-      if (written_len != EVENT_LIST_CHARS_WRITTEN) {
-        fprintf(stderr, "Error writing to buffer1\n");
-        return 1;
-      }
-      written_len = snprintf(buffer + EVENT_LIST_CHARS_WRITTEN,
-                             EVENT_LIST_BUFFER_SIZE - EVENT_LIST_CHARS_WRITTEN,
-                             "%u\n", (current->event)->id);
-      if (written_len != 2) {
-        fprintf(stderr, "Error writing to buffer2\n");
-        return 1;
-      }
-      bytes_written =
-          write(out_file, buffer,
-                EVENT_LIST_BUFFER_SIZE - 1); // remove null terminator
-      int check_bytes = check_bytes_written(
-          out_file, buffer, bytes_written, (ssize_t)EVENT_LIST_BUFFER_SIZE - 1);
-      if (check_bytes == 1) {
-        close(out_file);
-        return 1;
-      }
-      // printf("Event: ");
-      // printf("%u\n", (current->event)->id);
-      current = current->next;
+    unsigned int *row =
+        get_seat_span_with_delay(event, seat_index(event, i + 1, 1));
+    if (show_cache_render(cache, i, row, event->cols) != 0) {
+      pthread_mutex_unlock(&event->show_lock);
+      fprintf(stderr, "Error allocating memory for event rendering\n");
+      return 1;
     }
   }
-  close(out_file);
-  return 0;
+
+  int result = 0;
+  output_begin(out);
+  for (size_t i = 0; i < event->rows && result == 0; i++) {
+    result = output_append(out, cache->row_text[i].text,
+                           cache->row_text[i].len);
+  }
+  output_end(out);
+
+  pthread_mutex_unlock(&event->show_lock);
+  return result;
+}
+
+int ems_show(unsigned int event_id, struct Output *out) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  struct Event *event = get_event_with_delay(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  pthread_rwlock_rdlock(&event->lock);
+  int result = write_event(event, out);
+  pthread_rwlock_unlock(&event->lock);
+  return result;
+}
+
+int ems_list_events(struct Output *out) {
+  if (event_list == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  // The listing is kept up to date by CREATE, so it is written as is. Its
+  // length is loaded first: the listing it was published in, or any later
+  // copy, holds at least that many bytes.
+  size_t len =
+      atomic_load_explicit(&event_list->listing_len, memory_order_acquire);
+  if (len == 0) {
+    return output_write(out, NO_EVENTS_MESSAGE, NO_EVENTS_LEN);
+  }
+  return output_write(
+      out, atomic_load_explicit(&event_list->listing, memory_order_acquire),
+      len);
 }
 
 void ems_wait(unsigned int delay_ms) {
@@ -326,7 +743,7 @@ int ems_submit_file(char *filepath) {
     fprintf(stderr, "Error opening file\n");
     return 1;
   }
-  if (exec_file(fd, filepath)) {
+  if (exec_file(fd, filepath, 1, NULL)) {
     fprintf(stderr, "Error executing file\n");
     return 1;
   }
@@ -334,33 +751,7 @@ int ems_submit_file(char *filepath) {
   return 0;
 }
 
-int ems_help(char *job_filepath) {
-
-  char *out_file_path = generate_filepath(job_filepath);
-  if (out_file_path == NULL) {
-    fprintf(stderr, "Error generating filepath\n");
-    return 1;
-  }
-  int out_file = open(out_file_path, O_CREAT | O_WRONLY | O_APPEND,
-                      0666); // FIXME: what file permission number to use
-  if (out_file == -1) {
-    fprintf(stderr, "Error opening file\n");
-    return 1;
-  }
-
-  ssize_t bytes_written;
-  char buffer[HELP_BUFFER_SIZE];
-  memset(buffer, '\0', HELP_BUFFER_SIZE);
-  strcpy(buffer, HELP_MESSAGE);
-
-  bytes_written = write(out_file, buffer,
-                        HELP_BUFFER_SIZE - 1); // remove null terminator
-  int check_bytes = check_bytes_written(out_file, buffer, bytes_written,
-                                        (ssize_t)HELP_BUFFER_SIZE - 1);
-  close(out_file);
-
-  if (check_bytes == 1) {
-    return 1;
-  }
-  return 0;
-}
\ No newline at end of file
+int ems_help(struct Output *out) {
+  // remove null terminator
+  return output_write(out, HELP_MESSAGE, HELP_BUFFER_SIZE - 1);
+}
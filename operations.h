@@ -3,11 +3,43 @@
 
 #include <stddef.h>
 
+#include "jobc.h"
+#include "output.h"
+#include "reader.h"
+#include "stats.h"
+
 /// Initializes the EMS state.
 /// @param delay_ms State access delay in milliseconds.
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
 int ems_init(unsigned int delay_ms);
 
+/// Initializes the EMS state with the events of an image.
+/// The image is mapped rather than read, so startup time does not depend on
+/// the number of seats.
+/// @param delay_ms State access delay in milliseconds.
+/// @param image_filepath Path of an image written by ems_snapshot.
+/// @return 0 if the EMS state was restored successfully, 1 otherwise.
+int ems_init_from_image(unsigned int delay_ms, const char *image_filepath);
+
+/// Saves every event of the EMS state to an image. The write-ahead log, if
+/// attached, is truncated as its records are then part of the image.
+/// @note No command may run concurrently when a log is attached.
+/// @param image_filepath Path of the image.
+/// @return 0 if the image was written successfully, 1 otherwise.
+int ems_snapshot(const char *image_filepath);
+
+/// Attaches a write-ahead log to the EMS state. The records already in the
+/// log are replayed first, then every event created and every reservation
+/// made is logged.
+/// @param wal_filepath Path of the log, created if it does not exist.
+/// @return 0 if the log was attached successfully, 1 otherwise.
+int ems_attach_wal(const char *wal_filepath);
+
+/// Makes every change logged so far durable. Does nothing when no
+/// write-ahead log is attached.
+/// @return 0 on success, 1 if the log has failed.
+int ems_sync();
+
 /// Destroys the EMS state.
 int ems_terminate();
 
@@ -27,14 +59,37 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs,
                 size_t *ys);
 
+/// Creates a reservation on each of several events, all or nothing.
+/// Events are locked in ascending id order, so concurrent transactions never
+/// deadlock.
+/// @param num_seats Number of seats to reserve, across every event.
+/// @param es Array of events of the seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if every reservation was created successfully, 1 otherwise, in
+/// which case none was.
+int ems_transaction(size_t num_seats, size_t *es, size_t *xs, size_t *ys);
+
+/// Reserves the leftmost run of consecutive free seats of the given length
+/// in the first row of the event that has one, and prints it as
+/// "<row> <first column> <last column>".
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve, at most a row.
+/// @param out Output to print the reserved seats to.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_best(unsigned int event_id, size_t num_seats,
+                     struct Output *out);
+
 /// Prints the given event.
 /// @param event_id Id of the event to print.
+/// @param out Output to print to.
 /// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(unsigned int event_id, char *job_filepath);
+int ems_show(unsigned int event_id, struct Output *out);
 
 /// Prints all the events.
+/// @param out Output to print to.
 /// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events(char *job_filepath);
+int ems_list_events(struct Output *out);
 
 /// Waits for a given amount of time.
 /// @param delay_us Delay in milliseconds.
@@ -44,8 +99,35 @@ void ems_wait(unsigned int delay_ms);
 /// @param file_path Path of the file to submit.
 int ems_submit_file(char *filepath);
 
-int exec_file(int fd, char *job_filepath);
+/// Executes a job file on a pool of worker threads.
+/// @param fd File descriptor of the job file.
+/// @param job_filepath Path of the job file, used to name the output file.
+/// @param max_threads Number of worker threads sharing the job.
+/// @param stats Stats to add the instrumentation of the job to, may be NULL.
+/// @return 0 if the job ran to completion, 1 otherwise.
+int exec_file(int fd, char *job_filepath, unsigned int max_threads,
+              struct Stats *stats);
+
+/// Executes a stream of commands on a pool of worker threads.
+/// The write-ahead log is synced and the output flushed at every BARRIER,
+/// and the output after every command if interactive, but left open. From
+/// then on it syncs the write-ahead log before every write.
+/// @param reader Reader over the commands, positioned after any header.
+/// @param out Output of the commands.
+/// @param compiled 1 if the stream is in the compiled (.jobc) format.
+/// @param interactive 1 to flush the output after every command, for a
+/// client that waits for each response.
+/// @param max_threads Number of worker threads sharing the stream.
+/// @param jobc Writer to record the parsed commands in, may be NULL.
+/// @param stats Stats to add the instrumentation to, may be NULL.
+/// @return 0 if the stream ran to completion, 1 otherwise.
+int exec_stream(struct Reader *reader, struct Output *out, int compiled,
+                int interactive, unsigned int max_threads,
+                struct JobcWriter *jobc, struct Stats *stats);
 
-int ems_help(char *job_filepath);
+/// Prints the usage of every command.
+/// @param out Output to print to.
+/// @return 0 if the usage was printed successfully, 1 otherwise.
+int ems_help(struct Output *out);
 
 #endif // EMS_OPERATIONS_H
@@ -0,0 +1,118 @@
+#include "output.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "auxiliar_functions.h"
+
+/// Writes bytes directly to the output file.
+/// @param out Output to write to.
+/// @param data Bytes to be written.
+/// @param len Number of bytes.
+/// @return 0 on success, 1 otherwise.
+static int write_through(struct Output *out, const char *data, size_t len) {
+  if (len == 0) {
+    return 0;
+  }
+  if (out->before_write != NULL && out->before_write() != 0) {
+    return 1;
+  }
+  ssize_t bytes_written = write(out->fd, data, len);
+  return check_bytes_written(out->fd, data, bytes_written, (ssize_t)len);
+}
+
+/// Writes the pending bytes to the file.
+/// @note The caller must hold the output lock.
+/// @param out Output to be flushed.
+/// @return 0 on success, 1 otherwise.
+static int flush_locked(struct Output *out) {
+  int result = write_through(out, out->buffer, out->len);
+  out->len = 0;
+  return result;
+}
+
+int output_open(struct Output *out, char *job_filepath) {
+  char *out_file_path = generate_filepath(job_filepath);
+  if (out_file_path == NULL) {
+    fprintf(stderr, "Error generating filepath\n");
+    return 1;
+  }
+
+  int fd = open(out_file_path, O_CREAT | O_WRONLY | O_APPEND,
+                0666); // FIXME: what file permission number to use
+  free(out_file_path);
+  if (fd == -1) {
+    fprintf(stderr, "Error opening file\n");
+    return 1;
+  }
+
+  return output_init(out, fd);
+}
+
+int output_init(struct Output *out, int fd) {
+  out->fd = fd;
+  out->buffer = malloc(OUTPUT_BUFFER_SIZE);
+  if (out->buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for output buffer\n");
+    close(out->fd);
+    return 1;
+  }
+  out->len = 0;
+  out->before_write = NULL;
+  pthread_mutex_init(&out->lock, NULL);
+  return 0;
+}
+
+int output_close(struct Output *out) {
+  int result = output_flush(out);
+  pthread_mutex_destroy(&out->lock);
+  free(out->buffer);
+  out->buffer = NULL;
+  if (close(out->fd) != 0) {
+    fprintf(stderr, "Error closing file\n");
+    result = 1;
+  }
+  return result;
+}
+
+void output_begin(struct Output *out) { pthread_mutex_lock(&out->lock); }
+
+int output_append(struct Output *out, const char *data, size_t len) {
+  if (out->len + len <= OUTPUT_BUFFER_SIZE) {
+    memcpy(out->buffer + out->len, data, len);
+    out->len += len;
+    return 0;
+  }
+
+  if (flush_locked(out) != 0) {
+    return 1;
+  }
+
+  // Too large to be worth buffering
+  if (len >= OUTPUT_BUFFER_SIZE) {
+    return write_through(out, data, len);
+  }
+
+  memcpy(out->buffer, data, len);
+  out->len = len;
+  return 0;
+}
+
+void output_end(struct Output *out) { pthread_mutex_unlock(&out->lock); }
+
+int output_write(struct Output *out, const char *data, size_t len) {
+  output_begin(out);
+  int result = output_append(out, data, len);
+  output_end(out);
+  return result;
+}
+
+int output_flush(struct Output *out) {
+  output_begin(out);
+  int result = flush_locked(out);
+  output_end(out);
+  return result;
+}
@@ -0,0 +1,69 @@
+#ifndef EMS_OUTPUT_H
+#define EMS_OUTPUT_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define OUTPUT_BUFFER_SIZE 65536
+
+/// Buffered output file of a job, shared by all of its threads.
+/// Writes are accumulated in memory and only reach the file when the buffer
+/// fills up or when it is explicitly flushed.
+struct Output {
+  int fd;               /// Output file descriptor.
+  char *buffer;         /// Pending bytes not yet written to fd.
+  size_t len;           /// Number of pending bytes.
+  pthread_mutex_t lock; /// Serializes the output of concurrent commands.
+  int (*before_write)(void); /// Called before any byte reaches fd, so the
+                             /// changes reported are durable first. NULL
+                             /// by default.
+};
+
+/// Opens the output file of a job (the job path with the .out extension).
+/// @param out Output to be initialized.
+/// @param job_filepath Path of the job file.
+/// @return 0 if the output was opened successfully, 1 otherwise.
+int output_open(struct Output *out, char *job_filepath);
+
+/// Initializes an output over an already open file descriptor, such as the
+/// response pipe of a session. The output takes ownership of fd.
+/// @param out Output to be initialized.
+/// @param fd File descriptor to write to, closed on failure.
+/// @return 0 if the output was initialized successfully, 1 otherwise.
+int output_init(struct Output *out, int fd);
+
+/// Flushes and closes an output.
+/// @param out Output to be closed.
+/// @return 0 if the pending bytes were written successfully, 1 otherwise.
+int output_close(struct Output *out);
+
+/// Starts a record: the bytes appended until output_end are never
+/// interleaved with those of other threads.
+/// @param out Output to be locked.
+void output_begin(struct Output *out);
+
+/// Appends bytes to the current record.
+/// @note Must be called between output_begin and output_end.
+/// @param out Output to append to.
+/// @param data Bytes to be appended.
+/// @param len Number of bytes.
+/// @return 0 on success, 1 if a flush failed.
+int output_append(struct Output *out, const char *data, size_t len);
+
+/// Ends the current record.
+/// @param out Output to be unlocked.
+void output_end(struct Output *out);
+
+/// Writes a whole record at once.
+/// @param out Output to write to.
+/// @param data Bytes to be written.
+/// @param len Number of bytes.
+/// @return 0 on success, 1 if a flush failed.
+int output_write(struct Output *out, const char *data, size_t len);
+
+/// Writes all the pending bytes to the file.
+/// @param out Output to be flushed.
+/// @return 0 on success, 1 otherwise.
+int output_flush(struct Output *out);
+
+#endif // EMS_OUTPUT_H
@@ -7,152 +7,241 @@
 
 #include "constants.h"
 
-static int read_uint(int fd, unsigned int *value, char *next) {
-  char buf[16];
+static int read_uint(struct Reader *reader, unsigned int *value, char *next) {
+  unsigned long ul = 0;
+  int overflow = 0;
 
-  int i = 0;
   while (1) {
-    if (read(fd, buf + i, 1) == 0) {
+    if (reader->pos == reader->len && !reader_refill(reader)) {
       *next = '\0';
       break;
     }
 
-    *next = buf[i];
+    // Scan the digits available in memory without going through the reader
+    const char *data = reader->data;
+    size_t pos = reader->pos;
+    size_t len = reader->len;
+    while (pos < len && data[pos] >= '0' && data[pos] <= '9') {
+      ul = ul * 10 + (unsigned long)(data[pos] - '0');
+      if (ul > UINT_MAX) {
+        overflow = 1;
+        ul = UINT_MAX;
+      }
+      pos++;
+    }
+    reader->pos = pos;
 
-    if (buf[i] > '9' || buf[i] < '0') {
-      buf[i] = '\0';
+    if (pos < len) {
+      *next = data[reader->pos++];
       break;
     }
+  }
+
+  if (overflow) {
+    return 1;
+  }
+
+  *value = (unsigned int)ul;
+
+  return 0;
+}
+
+static void cleanup(struct Reader *reader) {
+  while (reader->pos < reader->len || reader_refill(reader)) {
+    const char *newline = memchr(reader->data + reader->pos, '\n',
+                                 reader->len - reader->pos);
+    if (newline != NULL) {
+      reader->pos = (size_t)(newline - reader->data) + 1;
+      return;
+    }
+    reader->pos = reader->len;
+  }
+}
 
-    i++;
+int command_args_init(struct CommandArgs *args) {
+  args->num_coords = 0;
+  args->max_coords = 0;
+  args->es = NULL;
+  args->xs = NULL;
+  args->ys = NULL;
+  return command_args_reserve(args, INITIAL_RESERVATION_SIZE);
+}
+
+int command_args_reserve(struct CommandArgs *args, size_t num_coords) {
+  if (num_coords <= args->max_coords) {
+    return 0;
   }
 
-  unsigned long ul = strtoul(buf, NULL, 10);
+  // Doubling keeps the cost of growing a large reservation linear
+  size_t capacity = args->max_coords > 0 ? args->max_coords : 1;
+  while (capacity < num_coords) {
+    capacity *= 2;
+  }
 
-  if (ul > UINT_MAX) {
+  size_t *es = realloc(args->es, capacity * sizeof(size_t));
+  if (es == NULL) {
+    fprintf(stderr, "Error allocating memory for coordinates\n");
     return 1;
   }
+  args->es = es;
 
-  *value = (unsigned int)ul;
+  size_t *xs = realloc(args->xs, capacity * sizeof(size_t));
+  if (xs == NULL) {
+    fprintf(stderr, "Error allocating memory for coordinates\n");
+    return 1;
+  }
+  args->xs = xs;
 
+  size_t *ys = realloc(args->ys, capacity * sizeof(size_t));
+  if (ys == NULL) {
+    fprintf(stderr, "Error allocating memory for coordinates\n");
+    return 1;
+  }
+  args->ys = ys;
+
+  args->max_coords = capacity;
   return 0;
 }
 
-static void cleanup(int fd) {
-  char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
-    ;
+void command_args_destroy(struct CommandArgs *args) {
+  free(args->es);
+  free(args->xs);
+  free(args->ys);
+  args->es = NULL;
+  args->xs = NULL;
+  args->ys = NULL;
+  args->max_coords = 0;
 }
 
-enum Command get_next(int fd) {
+enum Command get_next(struct Reader *reader) {
   char buf[16];
   memset(buf, '\0', 16);
-  ssize_t bytes_read = read(fd, buf, 1);
-  if (bytes_read != 1) {
+  if (!reader_getc(reader, buf)) {
     return EOC;
   }
 
   switch (buf[0]) {
   case 'C':
-    if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
-      cleanup(fd);
+    if (reader_read(reader, buf + 1, 6) != 6 ||
+        strncmp(buf, "CREATE ", 7) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
     return CMD_CREATE;
 
   case 'R':
-    if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
-      cleanup(fd);
+    if (reader_read(reader, buf + 1, 7) != 7 ||
+        strncmp(buf, "RESERVE", 7) != 0) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+
+    if (buf[7] == ' ') {
+      return CMD_RESERVE;
+    }
+
+    if (buf[7] != '_' || reader_read(reader, buf + 8, 5) != 5 ||
+        strncmp(buf, "RESERVE_BEST ", 13) != 0) {
+      cleanup(reader);
+      return CMD_INVALID;
+    }
+    return CMD_RESERVE_BEST;
+
+  case 'T':
+    if (reader_read(reader, buf + 1, 11) != 11 ||
+        strncmp(buf, "TRANSACTION ", 12) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
-    return CMD_RESERVE;
+    return CMD_TRANSACTION;
 
   case 'S':
-    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
-      cleanup(fd);
+    if (reader_read(reader, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
     return CMD_SHOW;
 
   case 'L':
-    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
-      cleanup(fd);
+    if (reader_read(reader, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-      cleanup(fd);
+    if (reader_read(reader, buf + 4, 1) != 0 && buf[4] != '\n') {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_LIST_EVENTS;
 
   case 'B':
-    if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "BARRIER", 7) != 0) {
-      cleanup(fd);
+    if (reader_read(reader, buf + 1, 6) != 6 ||
+        strncmp(buf, "BARRIER", 7) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    if (read(fd, buf + 7, 1) != 0 && buf[7] != '\n') {
-      cleanup(fd);
+    if (reader_read(reader, buf + 7, 1) != 0 && buf[7] != '\n') {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_BARRIER;
 
   case 'W':
-    if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-      cleanup(fd);
+    if (reader_read(reader, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_WAIT;
 
   case 'H':
-    if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
-      cleanup(fd);
+    if (reader_read(reader, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
-    if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-      cleanup(fd);
+    if (reader_read(reader, buf + 4, 1) != 0 && buf[4] != '\n') {
+      cleanup(reader);
       return CMD_INVALID;
     }
 
     return CMD_HELP;
 
   case '#':
-    cleanup(fd);
+    cleanup(reader);
     return CMD_EMPTY;
 
   case '\n':
     return CMD_EMPTY;
 
   default:
-    cleanup(fd);
+    cleanup(reader);
     return CMD_INVALID;
   }
 }
 
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows,
-                 size_t *num_cols) {
+int parse_create(struct Reader *reader, unsigned int *event_id,
+                 size_t *num_rows, size_t *num_cols) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 1;
   }
 
   unsigned int u_num_rows;
-  if (read_uint(fd, &u_num_rows, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
+  if (read_uint(reader, &u_num_rows, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
     return 1;
   }
   *num_rows = (size_t)u_num_rows;
 
   unsigned int u_num_cols;
-  if (read_uint(fd, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_uint(reader, &u_num_cols, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 1;
   }
   *num_cols = (size_t)u_num_cols;
@@ -160,93 +249,153 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows,
   return 0;
 }
 
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs,
-                     size_t *ys) {
+/// Parses a list of coordinates, "[(<x1>,<y1>) (<x2>,<y2>) ...]", after
+/// those already in the arguments of a command.
+/// @param reader Reader positioned at the opening bracket.
+/// @param args Arguments to append the coordinates to. The coordinate
+/// buffers grow to fit.
+/// @return 0 if the list was parsed successfully, 1 otherwise.
+static int parse_coords(struct Reader *reader, struct CommandArgs *args) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
-    return 0;
+  if (!reader_getc(reader, &ch) || ch != '[') {
+    return 1;
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
-    return 0;
-  }
+  while (1) {
+    if (args->num_coords == args->max_coords &&
+        command_args_reserve(args, args->num_coords + 1) != 0) {
+      return 1;
+    }
 
-  size_t num_coords = 0;
-  while (num_coords < max) {
-    if (read(fd, &ch, 1) != 1 || ch != '(') {
-      cleanup(fd);
-      return 0;
+    if (!reader_getc(reader, &ch) || ch != '(') {
+      return 1;
     }
 
     unsigned int x;
-    if (read_uint(fd, &x, &ch) != 0 || ch != ',') {
-      cleanup(fd);
-      return 0;
+    if (read_uint(reader, &x, &ch) != 0 || ch != ',') {
+      return 1;
     }
-    xs[num_coords] = (size_t)x;
+    args->xs[args->num_coords] = (size_t)x;
 
     unsigned int y;
-    if (read_uint(fd, &y, &ch) != 0 || ch != ')') {
-      cleanup(fd);
-      return 0;
+    if (read_uint(reader, &y, &ch) != 0 || ch != ')') {
+      return 1;
     }
-    ys[num_coords] = (size_t)y;
+    args->ys[args->num_coords] = (size_t)y;
 
-    num_coords++;
+    args->num_coords++;
 
-    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
-      cleanup(fd);
-      return 0;
+    if (!reader_getc(reader, &ch) || (ch != ' ' && ch != ']')) {
+      return 1;
     }
 
     if (ch == ']') {
-      break;
+      return 0;
     }
   }
+}
 
-  if (num_coords == max) {
-    cleanup(fd);
-    return 0;
+int parse_reserve(struct Reader *reader, struct CommandArgs *args) {
+  char ch;
+
+  if (read_uint(reader, &args->event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
+    return 1;
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
-    return 0;
+  args->num_coords = 0;
+  if (parse_coords(reader, args) != 0) {
+    cleanup(reader);
+    return 1;
+  }
+
+  if (!reader_getc(reader, &ch) || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
+    return 1;
+  }
+
+  return 0;
+}
+
+int parse_transaction(struct Reader *reader, struct CommandArgs *args) {
+  char ch = ' ';
+
+  args->num_coords = 0;
+  while (ch == ' ') {
+    unsigned int event_id;
+    if (read_uint(reader, &event_id, &ch) != 0 || ch != ' ') {
+      cleanup(reader);
+      return 1;
+    }
+
+    size_t first = args->num_coords;
+    if (parse_coords(reader, args) != 0) {
+      cleanup(reader);
+      return 1;
+    }
+    for (size_t i = first; i < args->num_coords; i++) {
+      args->es[i] = (size_t)event_id;
+    }
+
+    if (!reader_getc(reader, &ch) ||
+        (ch != ' ' && ch != '\n' && ch != '\0')) {
+      cleanup(reader);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int parse_reserve_best(struct Reader *reader, unsigned int *event_id,
+                       size_t *num_seats) {
+  char ch;
+
+  if (read_uint(reader, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(reader);
+    return 1;
   }
 
-  return num_coords;
+  unsigned int u_num_seats;
+  if (read_uint(reader, &u_num_seats, &ch) != 0 ||
+      (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
+    return 1;
+  }
+  *num_seats = (size_t)u_num_seats;
+
+  return 0;
 }
 
-int parse_show(int fd, unsigned int *event_id) {
+int parse_show(struct Reader *reader, unsigned int *event_id) {
   char ch;
 
-  if (read_uint(fd, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_uint(reader, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(reader);
     return 1;
   }
 
   return 0;
 }
 
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
+int parse_wait(struct Reader *reader, unsigned int *delay,
+               unsigned int *thread_id) {
   char ch;
 
-  if (read_uint(fd, delay, &ch) != 0) {
-    cleanup(fd);
+  if (read_uint(reader, delay, &ch) != 0) {
+    cleanup(reader);
     return -1;
   }
 
   if (ch == ' ') {
     if (thread_id == NULL) {
-      cleanup(fd);
+      cleanup(reader);
       return 0;
     }
 
-    if (read_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-      cleanup(fd);
+    if (read_uint(reader, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      cleanup(reader);
       return -1;
     }
 
@@ -254,7 +403,46 @@ int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   } else if (ch == '\n' || ch == '\0') {
     return 0;
   } else {
-    cleanup(fd);
+    cleanup(reader);
     return -1;
   }
 }
+
+int parse_command(struct Reader *reader, enum Command *command,
+                  struct CommandArgs *args) {
+  *command = get_next(reader);
+
+  switch (*command) {
+  case CMD_CREATE:
+    return parse_create(reader, &args->event_id, &args->num_rows,
+                        &args->num_cols);
+
+  case CMD_RESERVE:
+    return parse_reserve(reader, args);
+
+  case CMD_RESERVE_BEST:
+    return parse_reserve_best(reader, &args->event_id, &args->num_seats);
+
+  case CMD_TRANSACTION:
+    return parse_transaction(reader, args);
+
+  case CMD_SHOW:
+    return parse_show(reader, &args->event_id);
+
+  case CMD_WAIT: {
+    int result = parse_wait(reader, &args->delay, &args->thread_id);
+    args->has_thread_id = result == 1;
+    return result == -1;
+  }
+
+  case CMD_LIST_EVENTS:
+  case CMD_BARRIER:
+  case CMD_HELP:
+  case CMD_EMPTY:
+  case CMD_INVALID:
+  case EOC:
+    return 0;
+  }
+
+  return 1;
+}
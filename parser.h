@@ -3,9 +3,13 @@
 
 #include <stddef.h>
 
+#include "reader.h"
+
 enum Command {
   CMD_CREATE,
   CMD_RESERVE,
+  CMD_RESERVE_BEST,
+  CMD_TRANSACTION,
   CMD_SHOW,
   CMD_LIST_EVENTS,
   CMD_BARRIER,
@@ -16,43 +20,98 @@ enum Command {
   EOC // End of commands
 };
 
+/// Arguments of a command, as filled by parse_command.
+struct CommandArgs {
+  unsigned int event_id; /// CREATE, RESERVE, RESERVE_BEST and SHOW.
+  size_t num_rows;       /// CREATE.
+  size_t num_cols;       /// CREATE.
+  size_t num_coords;     /// RESERVE and TRANSACTION, number of coordinates.
+  size_t max_coords;     /// Capacity of es, xs and ys, grown as needed.
+  size_t *es;            /// TRANSACTION events of the coordinates.
+  size_t *xs;            /// RESERVE and TRANSACTION rows.
+  size_t *ys;            /// RESERVE and TRANSACTION columns.
+  size_t num_seats;      /// RESERVE_BEST.
+  unsigned int delay;    /// WAIT.
+  unsigned int thread_id; /// WAIT, only meaningful if has_thread_id is set.
+  int has_thread_id;      /// WAIT.
+};
+
+/// Initializes the arguments of a command. The coordinate buffers are
+/// reused by every command parsed into the same arguments.
+/// @param args Arguments to be initialized.
+/// @return 0 on success, 1 if memory ran out.
+int command_args_init(struct CommandArgs *args);
+
+/// Grows the coordinate buffers of a command to hold num_coords
+/// coordinates.
+/// @param args Arguments of the command.
+/// @param num_coords Number of coordinates.
+/// @return 0 on success, 1 if memory ran out.
+int command_args_reserve(struct CommandArgs *args, size_t num_coords);
+
+/// Frees the coordinate buffers of a command.
+/// @param args Arguments to be destroyed.
+void command_args_destroy(struct CommandArgs *args);
+
 /// Reads a line and returns the corresponding command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @return The command read.
-enum Command get_next(int fd);
+enum Command get_next(struct Reader *reader);
 
 /// Parses a CREATE command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @param num_rows Pointer to the variable to store the number of rows in.
 /// @param num_cols Pointer to the variable to store the number of columns in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-int parse_create(int fd, unsigned int *event_id, size_t *num_rows,
-                 size_t *num_cols);
+int parse_create(struct Reader *reader, unsigned int *event_id,
+                 size_t *num_rows, size_t *num_cols);
 
-/// Parses a RESERVE command.
-/// @param fd File descriptor to read from.
-/// @param max Maximum number of coordinates to read.
+/// Parses a RESERVE command, with any number of coordinates.
+/// @param reader Reader to read from.
+/// @param args Arguments to store the event ID and the coordinates in. The
+/// coordinate buffers grow to fit.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_reserve(struct Reader *reader, struct CommandArgs *args);
+
+/// Parses a RESERVE_BEST command.
+/// @param reader Reader to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
-/// @param xs Pointer to the array to store the X coordinates in.
-/// @param ys Pointer to the array to store the Y coordinates in.
-/// @return Number of coordinates read. 0 on failure.
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs,
-                     size_t *ys);
+/// @param num_seats Pointer to the variable to store the number of seats in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_reserve_best(struct Reader *reader, unsigned int *event_id,
+                       size_t *num_seats);
+
+/// Parses a TRANSACTION command, with one or more events, each followed by
+/// its coordinates as in RESERVE.
+/// @param reader Reader to read from.
+/// @param args Arguments to store the coordinates and their events in. The
+/// coordinate buffers grow to fit.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_transaction(struct Reader *reader, struct CommandArgs *args);
 
 /// Parses a SHOW command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
-int parse_show(int fd, unsigned int *event_id);
+int parse_show(struct Reader *reader, unsigned int *event_id);
 
 /// Parses a WAIT command.
-/// @param fd File descriptor to read from.
+/// @param reader Reader to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
 /// @param thread_id Pointer to the variable to store the thread ID in. May not
 /// be set.
 /// @return 0 if no thread was specified, 1 if a thread was specified, -1 on
 /// error.
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id);
+int parse_wait(struct Reader *reader, unsigned int *delay,
+               unsigned int *thread_id);
+
+/// Reads a whole command, including its arguments.
+/// @param reader Reader to read from.
+/// @param command Pointer to the variable to store the command in.
+/// @param args Arguments of the command, set up with command_args_init.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_command(struct Reader *reader, enum Command *command,
+                  struct CommandArgs *args);
 
 #endif // EMS_PARSER_H
@@ -0,0 +1,93 @@
+#include "reader.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int reader_init(struct Reader *reader, int fd) {
+  reader->fd = fd;
+  reader->data = NULL;
+  reader->len = 0;
+  reader->pos = 0;
+  reader->mapped = 0;
+  reader->buffer = NULL;
+
+  if (fd < 0) {
+    fprintf(stderr, "Invalid file descriptor\n");
+    return 1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+      reader->data = map;
+      reader->len = (size_t)st.st_size;
+      reader->mapped = 1;
+      return 0;
+    }
+  }
+
+  // Not mappable, fall back to buffered reads
+  reader->buffer = malloc(READER_BUFFER_SIZE);
+  if (reader->buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for reader buffer\n");
+    return 1;
+  }
+  reader->data = reader->buffer;
+  return 0;
+}
+
+void reader_destroy(struct Reader *reader) {
+  if (reader->mapped) {
+    munmap((void *)reader->data, reader->len);
+  } else {
+    free(reader->buffer);
+  }
+  reader->data = NULL;
+  reader->buffer = NULL;
+  reader->len = 0;
+  reader->pos = 0;
+  reader->mapped = 0;
+}
+
+int reader_refill(struct Reader *reader) {
+  if (reader->mapped || reader->buffer == NULL) {
+    return 0;
+  }
+
+  ssize_t bytes_read;
+  do {
+    bytes_read = read(reader->fd, reader->buffer, READER_BUFFER_SIZE);
+  } while (bytes_read == -1 && errno == EINTR);
+
+  if (bytes_read <= 0) {
+    reader->len = 0;
+    reader->pos = 0;
+    return 0;
+  }
+
+  reader->len = (size_t)bytes_read;
+  reader->pos = 0;
+  return 1;
+}
+
+size_t reader_read(struct Reader *reader, char *dst, size_t count) {
+  size_t copied = 0;
+  while (copied < count) {
+    if (reader->pos == reader->len && !reader_refill(reader)) {
+      break;
+    }
+    size_t available = reader->len - reader->pos;
+    size_t chunk = count - copied < available ? count - copied : available;
+    memcpy(dst + copied, reader->data + reader->pos, chunk);
+    reader->pos += chunk;
+    copied += chunk;
+  }
+  return copied;
+}
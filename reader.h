@@ -0,0 +1,55 @@
+#ifndef EMS_READER_H
+#define EMS_READER_H
+
+#include <stddef.h>
+
+#define READER_BUFFER_SIZE 65536
+
+/// Input source for the command parser.
+/// Regular files are memory-mapped and scanned in place. Anything that cannot
+/// be mapped (pipes, empty files) is read through a large refill buffer.
+struct Reader {
+  int fd;           /// File descriptor being read.
+  const char *data; /// Mapped file contents or the refill buffer.
+  size_t len;       /// Number of valid bytes in data.
+  size_t pos;       /// Position of the next byte to be consumed.
+  int mapped;       /// 1 if data is a mapping of the whole file.
+  char *buffer;     /// Refill buffer, NULL when the file is mapped.
+};
+
+/// Initializes a reader over the given file descriptor.
+/// @param reader Reader to be initialized.
+/// @param fd File descriptor to read from.
+/// @return 0 if the reader was initialized successfully, 1 otherwise.
+int reader_init(struct Reader *reader, int fd);
+
+/// Releases the mapping or buffer held by the reader.
+/// @note Does not close the file descriptor.
+/// @param reader Reader to be destroyed.
+void reader_destroy(struct Reader *reader);
+
+/// Refills the buffer of a non-mapped reader.
+/// @param reader Reader to be refilled.
+/// @return 1 if new bytes are available, 0 on end of file or error.
+int reader_refill(struct Reader *reader);
+
+/// Reads a single byte.
+/// @param reader Reader to read from.
+/// @param ch Pointer to the variable to store the byte in.
+/// @return 1 if a byte was read, 0 on end of file.
+static inline int reader_getc(struct Reader *reader, char *ch) {
+  if (reader->pos == reader->len && !reader_refill(reader)) {
+    return 0;
+  }
+  *ch = reader->data[reader->pos++];
+  return 1;
+}
+
+/// Reads up to count bytes.
+/// @param reader Reader to read from.
+/// @param dst Buffer to store the bytes in.
+/// @param count Number of bytes to read.
+/// @return Number of bytes read, less than count only on end of file.
+size_t reader_read(struct Reader *reader, char *dst, size_t count);
+
+#endif // EMS_READER_H
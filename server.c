@@ -0,0 +1,405 @@
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "operations.h"
+#include "output.h"
+#include "reader.h"
+#include "stats.h"
+
+struct Session {
+  char request_pipe[SERVER_PIPE_PATH_MAX + 1];
+  char response_pipe[SERVER_PIPE_PATH_MAX + 1];
+};
+
+// Bounded queue of registered sessions. The host thread produces, the
+// session workers consume.
+struct SessionQueue {
+  struct Session *sessions; // Ring buffer of capacity slots
+  size_t capacity;
+  size_t head; // Slot of the oldest session
+  size_t len;  // Number of queued sessions
+  int closed;  // Set on shutdown, no more sessions are accepted
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+};
+
+struct Server {
+  struct SessionQueue queue;
+  unsigned int max_threads; // Worker threads of each session
+  struct Stats stats;       // Instrumentation of the finished sessions
+  unsigned int sessions;    // Number of finished sessions
+  pthread_mutex_t stats_lock;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/// Signal handler that asks the server to shut down.
+/// @param signum Signal number, unused.
+static void request_stop(int signum) {
+  (void)signum;
+  stop_requested = 1;
+}
+
+/// Initializes an empty session queue.
+/// @param queue Queue to be initialized.
+/// @param capacity Maximum number of queued sessions.
+/// @return 0 on success, 1 otherwise.
+static int queue_init(struct SessionQueue *queue, size_t capacity) {
+  queue->sessions = malloc(capacity * sizeof(struct Session));
+  if (queue->sessions == NULL) {
+    return 1;
+  }
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->len = 0;
+  queue->closed = 0;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->not_empty, NULL);
+  pthread_cond_init(&queue->not_full, NULL);
+  return 0;
+}
+
+/// Destroys a session queue.
+/// @param queue Queue to be destroyed.
+static void queue_destroy(struct SessionQueue *queue) {
+  pthread_cond_destroy(&queue->not_full);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->sessions);
+}
+
+/// Adds a session to the queue, waiting while it is full.
+/// @param queue Queue to add to.
+/// @param session Session to be added.
+/// @return 0 on success, 1 if the queue was closed.
+static int queue_push(struct SessionQueue *queue,
+                      const struct Session *session) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->len == queue->capacity && !queue->closed) {
+    pthread_cond_wait(&queue->not_full, &queue->lock);
+  }
+  if (queue->closed) {
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+  }
+  queue->sessions[(queue->head + queue->len) % queue->capacity] = *session;
+  queue->len++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+  return 0;
+}
+
+/// Takes the oldest session from the queue, waiting while it is empty.
+/// @param queue Queue to take from.
+/// @param session Where the session is stored.
+/// @return 0 on success, 1 if the queue was closed and drained.
+static int queue_pop(struct SessionQueue *queue, struct Session *session) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->len == 0 && !queue->closed) {
+    pthread_cond_wait(&queue->not_empty, &queue->lock);
+  }
+  if (queue->len == 0) {
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+  }
+  *session = queue->sessions[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->len--;
+  pthread_cond_signal(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+  return 0;
+}
+
+/// Closes the queue: sessions already queued are still served, but no new
+/// ones are accepted and idle workers are woken up to exit.
+/// @param queue Queue to be closed.
+static void queue_close(struct SessionQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = 1;
+  pthread_cond_broadcast(&queue->not_empty);
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/// Reads a setup message from the register pipe.
+/// @param fd File descriptor of the register pipe.
+/// @param session Where the pipe paths of the session are stored.
+/// @return 0 on success, 1 if the message is malformed, -1 if the pipe
+/// could not be read or a signal arrived before the message started.
+static int read_setup(int fd, struct Session *session) {
+  char message[SERVER_SETUP_SIZE];
+  size_t len = 0;
+  while (len < SERVER_SETUP_SIZE) {
+    ssize_t bytes_read = read(fd, message + len, SERVER_SETUP_SIZE - len);
+    if (bytes_read == -1 && errno == EINTR && len > 0) {
+      // Dropping the bytes read so far would misalign every later message
+      continue;
+    }
+    if (bytes_read <= 0) {
+      return -1;
+    }
+    len += (size_t)bytes_read;
+  }
+
+  if (message[0] != SERVER_OP_SETUP) {
+    return 1;
+  }
+  memcpy(session->request_pipe, message + 1, SERVER_PIPE_PATH_MAX);
+  session->request_pipe[SERVER_PIPE_PATH_MAX] = '\0';
+  memcpy(session->response_pipe, message + 1 + SERVER_PIPE_PATH_MAX,
+         SERVER_PIPE_PATH_MAX);
+  session->response_pipe[SERVER_PIPE_PATH_MAX] = '\0';
+  return session->request_pipe[0] == '\0' || session->response_pipe[0] == '\0';
+}
+
+/// Runs the commands of a session on the shared EMS state.
+/// The pipes are opened in the order the client opens them, request first.
+/// @param server Server the session belongs to.
+/// @param session Session to be served.
+static void serve_session(struct Server *server,
+                          const struct Session *session) {
+  int request_fd = open(session->request_pipe, O_RDONLY);
+  if (request_fd == -1) {
+    fprintf(stderr, "Failed to open request pipe %s\n",
+            session->request_pipe);
+    return;
+  }
+
+  int response_fd = open(session->response_pipe, O_WRONLY);
+  if (response_fd == -1) {
+    fprintf(stderr, "Failed to open response pipe %s\n",
+            session->response_pipe);
+    close(request_fd);
+    return;
+  }
+
+  struct Reader reader;
+  if (reader_init(&reader, request_fd)) {
+    fprintf(stderr, "Failed to read request pipe %s\n",
+            session->request_pipe);
+    close(response_fd);
+    close(request_fd);
+    return;
+  }
+
+  struct Output out;
+  if (output_init(&out, response_fd)) {
+    reader_destroy(&reader);
+    close(request_fd);
+    return;
+  }
+
+  struct Stats stats;
+  stats_init(&stats);
+  if (exec_stream(&reader, &out, 0, 1, server->max_threads, NULL, &stats)) {
+    fprintf(stderr, "Session %s aborted\n", session->request_pipe);
+  }
+
+  // Closing the response pipe tells the client the session is over
+  if (output_close(&out)) {
+    fprintf(stderr, "Failed to write response pipe %s\n",
+            session->response_pipe);
+  }
+  reader_destroy(&reader);
+  close(request_fd);
+
+  pthread_mutex_lock(&server->stats_lock);
+  stats_merge(&server->stats, &stats);
+  server->sessions++;
+  pthread_mutex_unlock(&server->stats_lock);
+}
+
+/// Serves queued sessions until the queue is closed.
+/// @param arg Pointer to the struct Server.
+/// @return NULL.
+static void *session_worker(void *arg) {
+  struct Server *server = (struct Server *)arg;
+  struct Session session;
+  while (queue_pop(&server->queue, &session) == 0) {
+    serve_session(server, &session);
+  }
+  return NULL;
+}
+
+/// Opens the register pipe for reading. The server also keeps it open for
+/// writing, so reads block between clients instead of reaching end of file.
+/// @param register_pipe Path of the register pipe.
+/// @param write_fd Where the descriptor of the writing end is stored.
+/// @return Descriptor of the reading end, -1 on failure.
+static int open_register_pipe(const char *register_pipe, int *write_fd) {
+  int read_fd = open(register_pipe, O_RDONLY | O_NONBLOCK);
+  if (read_fd == -1) {
+    return -1;
+  }
+  *write_fd = open(register_pipe, O_WRONLY);
+  if (*write_fd == -1) {
+    close(read_fd);
+    return -1;
+  }
+
+  int flags = fcntl(read_fd, F_GETFL);
+  if (flags == -1 || fcntl(read_fd, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+    close(*write_fd);
+    close(read_fd);
+    return -1;
+  }
+  return read_fd;
+}
+
+int server_run(const char *register_pipe, unsigned int max_sessions,
+               unsigned int max_threads, unsigned int delay_ms,
+               const char *image_filepath, const char *wal_filepath) {
+  if (strlen(register_pipe) == 0) {
+    fprintf(stderr, "Invalid register pipe path\n");
+    return 1;
+  }
+
+  // Only a stale register pipe is replaced, never any other kind of file
+  struct stat st;
+  if (lstat(register_pipe, &st) == 0) {
+    if (!S_ISFIFO(st.st_mode)) {
+      fprintf(stderr, "%s exists and is not a pipe\n", register_pipe);
+      return 1;
+    }
+    if (unlink(register_pipe) != 0) {
+      fprintf(stderr, "Failed to remove register pipe %s\n", register_pipe);
+      return 1;
+    }
+  } else if (errno != ENOENT) {
+    fprintf(stderr, "Failed to check register pipe %s\n", register_pipe);
+    return 1;
+  }
+  if (mkfifo(register_pipe, 0640) != 0) {
+    fprintf(stderr, "Failed to create register pipe %s\n", register_pipe);
+    return 1;
+  }
+
+  int write_fd;
+  int register_fd = open_register_pipe(register_pipe, &write_fd);
+  if (register_fd == -1) {
+    fprintf(stderr, "Failed to open register pipe %s\n", register_pipe);
+    unlink(register_pipe);
+    return 1;
+  }
+
+  int restore = image_filepath != NULL && access(image_filepath, F_OK) == 0;
+  if (restore ? ems_init_from_image(delay_ms, image_filepath)
+              : ems_init(delay_ms)) {
+    fprintf(stderr, "Failed to initialize EMS\n");
+    close(write_fd);
+    close(register_fd);
+    unlink(register_pipe);
+    return 1;
+  }
+
+  if (wal_filepath != NULL && ems_attach_wal(wal_filepath)) {
+    fprintf(stderr, "Failed to attach write-ahead log %s\n", wal_filepath);
+    ems_terminate();
+    close(write_fd);
+    close(register_fd);
+    unlink(register_pipe);
+    return 1;
+  }
+
+  struct Server server;
+  server.max_threads = max_threads;
+  server.sessions = 0;
+  stats_init(&server.stats);
+  pthread_mutex_init(&server.stats_lock, NULL);
+  if (queue_init(&server.queue, max_sessions)) {
+    fprintf(stderr, "Error allocating memory for session queue\n");
+    pthread_mutex_destroy(&server.stats_lock);
+    ems_terminate();
+    close(write_fd);
+    close(register_fd);
+    unlink(register_pipe);
+    return 1;
+  }
+
+  // A client that goes away must only end its own session
+  signal(SIGPIPE, SIG_IGN);
+
+  // Stop signals are blocked in the workers, so they interrupt the read of
+  // the host thread below
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = request_stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  sigset_t stop_signals, old_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+  pthread_t *workers = malloc(max_sessions * sizeof(pthread_t));
+  unsigned int started = 0;
+  int result = 0;
+  if (workers == NULL) {
+    fprintf(stderr, "Error allocating memory for session workers\n");
+    result = 1;
+  } else {
+    for (; started < max_sessions; started++) {
+      if (pthread_create(&workers[started], NULL, session_worker, &server) !=
+          0) {
+        fprintf(stderr, "Failed to create thread\n");
+        result = 1;
+        break;
+      }
+    }
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+  // The host thread accepts sessions and hands them to the workers
+  while (result == 0 && !stop_requested) {
+    struct Session session;
+    int status = read_setup(register_fd, &session);
+    if (status == -1) {
+      if (errno != EINTR) {
+        fprintf(stderr, "Failed to read register pipe\n");
+        result = 1;
+      }
+    } else if (status == 1) {
+      fprintf(stderr, "Invalid setup message\n");
+    } else if (queue_push(&server.queue, &session)) {
+      break;
+    }
+  }
+
+  queue_close(&server.queue);
+  for (unsigned int i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+
+  printf("---- Stats of %u sessions -------------------------------\n",
+         server.sessions);
+  stats_print(&server.stats, stdout);
+
+  queue_destroy(&server.queue);
+  pthread_mutex_destroy(&server.stats_lock);
+  if (image_filepath != NULL && ems_snapshot(image_filepath)) {
+    fprintf(stderr, "Failed to save image %s\n", image_filepath);
+    result = 1;
+  }
+  if (ems_terminate()) {
+    result = 1;
+  }
+  close(write_fd);
+  close(register_fd);
+  unlink(register_pipe);
+  return result;
+}
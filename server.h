@@ -0,0 +1,30 @@
+#ifndef EMS_SERVER_H
+#define EMS_SERVER_H
+
+// A client registers a session by writing a setup message to the register
+// pipe of the server: the SERVER_OP_SETUP byte followed by the paths of its
+// request and response pipes, each padded with '\0' to SERVER_PIPE_PATH_MAX
+// bytes. Messages fit in PIPE_BUF, so those of concurrent clients never
+// interleave. The client then writes commands to its request pipe, in the
+// job file syntax, and reads their output from its response pipe. The
+// session ends when the client closes the request pipe.
+#define SERVER_OP_SETUP '1'
+#define SERVER_PIPE_PATH_MAX 40
+#define SERVER_SETUP_SIZE (1 + 2 * SERVER_PIPE_PATH_MAX)
+
+/// Runs the EMS as a server that keeps a single EMS state for all of its
+/// sessions, until it receives SIGINT or SIGTERM.
+/// @param register_pipe Path of the register pipe, created by the server.
+/// @param max_sessions Number of sessions served concurrently.
+/// @param max_threads Number of worker threads of each session.
+/// @param delay_ms State access delay in milliseconds.
+/// @param image_filepath Image the state is restored from, when it exists,
+/// and saved to on shutdown. May be NULL.
+/// @param wal_filepath Write-ahead log replayed at startup and attached to
+/// the state. May be NULL.
+/// @return 0 if the server shut down cleanly, 1 otherwise.
+int server_run(const char *register_pipe, unsigned int max_sessions,
+               unsigned int max_threads, unsigned int delay_ms,
+               const char *image_filepath, const char *wal_filepath);
+
+#endif // EMS_SERVER_H
@@ -0,0 +1,75 @@
+#include "showcache.h"
+
+#include <stdlib.h>
+
+#include "auxiliar_functions.h"
+
+struct ShowCache *show_cache_create(size_t rows) {
+  struct ShowCache *cache = malloc(sizeof(struct ShowCache));
+  if (!cache)
+    return NULL;
+
+  size_t num_words = (rows + 63) / 64;
+  cache->rows = rows;
+  cache->row_text = calloc(rows, sizeof(struct ShowRow));
+  cache->dirty = malloc(num_words * sizeof(uint64_t));
+  if (!cache->row_text || !cache->dirty) {
+    free(cache->row_text);
+    free(cache->dirty);
+    free(cache);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < num_words; i++) {
+    cache->dirty[i] = ~(uint64_t)0;
+  }
+  return cache;
+}
+
+int show_cache_render(struct ShowCache *cache, size_t row,
+                      const unsigned int *seats, size_t cols) {
+  struct ShowRow *text = &cache->row_text[row];
+
+  // A single digit per seat fits most rows, longer ids grow the buffer
+  if (text->capacity == 0) {
+    text->text = malloc(2 * cols + 1);
+    if (!text->text)
+      return 1;
+    text->capacity = 2 * cols + 1;
+  }
+
+  size_t len = 0;
+  for (size_t j = 0; j < cols; j++) {
+    // Room for the widest seat plus its separator
+    if (len + UINT_MAX_DIGITS + 1 > text->capacity) {
+      size_t capacity = text->capacity * 2;
+      if (capacity < len + UINT_MAX_DIGITS + 1) {
+        capacity = len + UINT_MAX_DIGITS + 1;
+      }
+      char *grown = realloc(text->text, capacity);
+      if (!grown)
+        return 1;
+      text->text = grown;
+      text->capacity = capacity;
+    }
+
+    len += format_uint(text->text + len, seats[j]);
+    text->text[len++] = j + 1 < cols ? ' ' : '\n';
+  }
+
+  text->len = len;
+  cache->dirty[row / 64] &= ~((uint64_t)1 << (row % 64));
+  return 0;
+}
+
+void show_cache_destroy(struct ShowCache *cache) {
+  if (!cache)
+    return;
+
+  for (size_t i = 0; i < cache->rows; i++) {
+    free(cache->row_text[i].text);
+  }
+  free(cache->row_text);
+  free(cache->dirty);
+  free(cache);
+}
@@ -0,0 +1,57 @@
+#ifndef EMS_SHOWCACHE_H
+#define EMS_SHOWCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Rendered text of a row of seats, as printed by SHOW.
+struct ShowRow {
+  char *text;      /// Seats separated by spaces and ended by a newline.
+  size_t len;      /// Number of bytes in text.
+  size_t capacity; /// Size of text, grows as reservation ids get longer.
+};
+
+/// Rendering of the seats of an event, kept between SHOWs. Only the rows
+/// marked dirty since the last SHOW have to be fetched and rendered again.
+struct ShowCache {
+  size_t rows;
+  struct ShowRow *row_text; /// Rendered rows, by row index.
+  uint64_t *dirty;          /// Bitmap with a set bit for each stale row.
+};
+
+/// Creates the cache of an event, with every row dirty.
+/// @param rows Number of rows.
+/// @return Newly created cache, NULL on failure.
+struct ShowCache *show_cache_create(size_t rows);
+
+/// Marks a row as changed since it was last rendered.
+/// @param cache Cache of the event.
+/// @param row Index of the row.
+static inline void show_cache_mark(struct ShowCache *cache, size_t row) {
+  cache->dirty[row / 64] |= (uint64_t)1 << (row % 64);
+}
+
+/// Checks whether a row has to be rendered again.
+/// @param cache Cache of the event.
+/// @param row Index of the row.
+/// @return 1 if the row is dirty, 0 otherwise.
+static inline int show_cache_is_dirty(const struct ShowCache *cache,
+                                      size_t row) {
+  return (cache->dirty[row / 64] >> (row % 64)) & 1;
+}
+
+/// Renders a row into the cache and marks it as clean.
+/// @param cache Cache of the event.
+/// @param row Index of the row.
+/// @param seats Seats of the row.
+/// @param cols Number of seats in the row.
+/// @return 0 if the row was rendered, 1 if memory ran out, in which case the
+/// row stays dirty.
+int show_cache_render(struct ShowCache *cache, size_t row,
+                      const unsigned int *seats, size_t cols);
+
+/// Frees a cache along with its rows.
+/// @param cache Cache to be freed, may be NULL.
+void show_cache_destroy(struct ShowCache *cache);
+
+#endif // EMS_SHOWCACHE_H
@@ -0,0 +1,218 @@
+#include "stats.h"
+
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+// Delay slept by the calling thread and not yet attributed to a command
+static _Thread_local uint64_t pending_delay_ns = 0;
+
+static const char *const command_names[STATS_NUM_COMMANDS] = {
+    [CMD_CREATE] = "CREATE",
+    [CMD_RESERVE] = "RESERVE",
+    [CMD_RESERVE_BEST] = "RESERVE_BEST",
+    [CMD_TRANSACTION] = "TRANSACTION",
+    [CMD_SHOW] = "SHOW",
+    [CMD_LIST_EVENTS] = "LIST",
+    [CMD_BARRIER] = "BARRIER",
+    [CMD_WAIT] = "WAIT",
+    [CMD_HELP] = "HELP",
+    [CMD_EMPTY] = "EMPTY",
+    [CMD_INVALID] = "INVALID",
+    [EOC] = "EOC"};
+
+#define PARSE_NAME "PARSE"
+
+void stats_init(struct Stats *stats) { memset(stats, 0, sizeof(*stats)); }
+
+uint64_t stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void stats_record(struct LatencyStats *latency, uint64_t elapsed_ns,
+                  uint64_t delay_ns) {
+  uint64_t elapsed_us = elapsed_ns / 1000;
+  unsigned int bucket = 0;
+  while (bucket < STATS_BUCKETS - 1 && elapsed_us >= ((uint64_t)1 << bucket)) {
+    bucket++;
+  }
+
+  latency->count++;
+  latency->total_ns += elapsed_ns;
+  latency->delay_ns += delay_ns;
+  latency->buckets[bucket]++;
+}
+
+void stats_add_delay(uint64_t delay_ns) { pending_delay_ns += delay_ns; }
+
+uint64_t stats_take_delay(void) {
+  uint64_t delay_ns = pending_delay_ns;
+  pending_delay_ns = 0;
+  return delay_ns;
+}
+
+/// Adds one latency distribution to another.
+/// @param dst Distribution to be updated.
+/// @param src Distribution to be added.
+static void merge_latency(struct LatencyStats *dst,
+                          const struct LatencyStats *src) {
+  dst->count += src->count;
+  dst->total_ns += src->total_ns;
+  dst->delay_ns += src->delay_ns;
+  for (unsigned int i = 0; i < STATS_BUCKETS; i++) {
+    dst->buckets[i] += src->buckets[i];
+  }
+}
+
+void stats_merge(struct Stats *dst, const struct Stats *src) {
+  for (unsigned int i = 0; i < STATS_NUM_COMMANDS; i++) {
+    merge_latency(&dst->commands[i], &src->commands[i]);
+  }
+  merge_latency(&dst->parse, &src->parse);
+  dst->wait_ns += src->wait_ns;
+  dst->wall_ns += src->wall_ns;
+}
+
+/// Writes one latency distribution as a line of a stats file.
+/// @param file Stream to write to.
+/// @param name Name of the operation kind.
+/// @param latency Distribution to be written.
+static void write_latency(FILE *file, const char *name,
+                          const struct LatencyStats *latency) {
+  fprintf(file, "%s %" PRIu64 " %" PRIu64 " %" PRIu64, name, latency->count,
+          latency->total_ns, latency->delay_ns);
+  for (unsigned int i = 0; i < STATS_BUCKETS; i++) {
+    fprintf(file, " %" PRIu64, latency->buckets[i]);
+  }
+  fprintf(file, "\n");
+}
+
+int stats_write(const struct Stats *stats, const char *path) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Error opening stats file %s\n", path);
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < STATS_NUM_COMMANDS; i++) {
+    write_latency(file, command_names[i], &stats->commands[i]);
+  }
+  write_latency(file, PARSE_NAME, &stats->parse);
+  fprintf(file, "wait_ns %" PRIu64 "\n", stats->wait_ns);
+  fprintf(file, "wall_ns %" PRIu64 "\n", stats->wall_ns);
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "Error writing stats file %s\n", path);
+    return 1;
+  }
+  return 0;
+}
+
+/// Finds the distribution with the given name.
+/// @param stats Stats to search.
+/// @param name Name of the operation kind.
+/// @return Pointer to the distribution, NULL if the name is unknown.
+static struct LatencyStats *find_latency(struct Stats *stats,
+                                         const char *name) {
+  for (unsigned int i = 0; i < STATS_NUM_COMMANDS; i++) {
+    if (strcmp(name, command_names[i]) == 0) {
+      return &stats->commands[i];
+    }
+  }
+  if (strcmp(name, PARSE_NAME) == 0) {
+    return &stats->parse;
+  }
+  return NULL;
+}
+
+int stats_read(struct Stats *stats, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Error opening stats file %s\n", path);
+    return 1;
+  }
+
+  struct Stats parsed;
+  stats_init(&parsed);
+
+  char name[16];
+  int result = 0;
+  while (result == 0 && fscanf(file, "%15s", name) == 1) {
+    if (strcmp(name, "wait_ns") == 0) {
+      result = fscanf(file, "%" SCNu64, &parsed.wait_ns) != 1;
+      continue;
+    }
+    if (strcmp(name, "wall_ns") == 0) {
+      result = fscanf(file, "%" SCNu64, &parsed.wall_ns) != 1;
+      continue;
+    }
+
+    struct LatencyStats *latency = find_latency(&parsed, name);
+    if (latency == NULL ||
+        fscanf(file, "%" SCNu64 " %" SCNu64 " %" SCNu64, &latency->count,
+               &latency->total_ns, &latency->delay_ns) != 3) {
+      result = 1;
+      break;
+    }
+    for (unsigned int i = 0; i < STATS_BUCKETS && result == 0; i++) {
+      result = fscanf(file, "%" SCNu64, &latency->buckets[i]) != 1;
+    }
+  }
+  fclose(file);
+
+  if (result != 0) {
+    fprintf(stderr, "Malformed stats file %s\n", path);
+    return 1;
+  }
+
+  stats_merge(stats, &parsed);
+  return 0;
+}
+
+/// Estimates a percentile from a histogram.
+/// @param latency Distribution to be inspected.
+/// @param percent Percentile, between 0 and 100.
+/// @return Upper bound of the bucket holding the percentile, in microseconds.
+static uint64_t percentile_us(const struct LatencyStats *latency,
+                              unsigned int percent) {
+  uint64_t target = (latency->count * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < STATS_BUCKETS; i++) {
+    seen += latency->buckets[i];
+    if (seen >= target) {
+      return (uint64_t)1 << i;
+    }
+  }
+  return (uint64_t)1 << (STATS_BUCKETS - 1);
+}
+
+/// Prints one line of the summary.
+/// @param file Stream to print to.
+/// @param name Name of the operation kind.
+/// @param latency Distribution to be printed.
+static void print_latency(FILE *file, const char *name,
+                          const struct LatencyStats *latency) {
+  if (latency->count == 0) {
+    return;
+  }
+  fprintf(file,
+          "%-12s %10" PRIu64 " %12.3f %12.3f %10.1f %8" PRIu64 " %8" PRIu64
+          "\n",
+          name, latency->count, (double)latency->total_ns / 1e6,
+          (double)latency->delay_ns / 1e6,
+          (double)latency->total_ns / 1e3 / (double)latency->count,
+          percentile_us(latency, 50), percentile_us(latency, 99));
+}
+
+void stats_print(const struct Stats *stats, FILE *file) {
+  fprintf(file, "%-12s %10s %12s %12s %10s %8s %8s\n", "command", "count",
+          "total_ms", "delay_ms", "mean_us", "p50<us", "p99<us");
+  for (unsigned int i = 0; i < STATS_NUM_COMMANDS; i++) {
+    print_latency(file, command_names[i], &stats->commands[i]);
+  }
+  print_latency(file, PARSE_NAME, &stats->parse);
+  fprintf(file, "wait_ms %.3f wall_ms %.3f\n", (double)stats->wait_ns / 1e6,
+          (double)stats->wall_ns / 1e6);
+}
@@ -0,0 +1,76 @@
+#ifndef EMS_STATS_H
+#define EMS_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "parser.h"
+
+#define STATS_BUCKETS 32 // Bucket i counts latencies below 2^i microseconds
+#define STATS_NUM_COMMANDS (EOC + 1)
+#define STATS_FILE_EXTENSION ".stats"
+
+/// Latency distribution of one kind of operation.
+struct LatencyStats {
+  uint64_t count;    /// Number of operations.
+  uint64_t total_ns; /// Total time spent in the operations.
+  uint64_t delay_ns; /// Part of total_ns spent in simulated access delays.
+  uint64_t buckets[STATS_BUCKETS]; /// Log2-bucketed latency histogram.
+};
+
+/// Instrumentation of a job.
+struct Stats {
+  struct LatencyStats commands[STATS_NUM_COMMANDS]; /// By enum Command.
+  struct LatencyStats parse; /// Parsing, including waiting for the parser.
+  uint64_t wait_ns;          /// Time spent in WAIT commands.
+  uint64_t wall_ns;          /// Wall-clock duration of the job.
+};
+
+/// Clears all the counters.
+/// @param stats Stats to be cleared.
+void stats_init(struct Stats *stats);
+
+/// Reads the monotonic clock.
+/// @return Current time in nanoseconds.
+uint64_t stats_now(void);
+
+/// Records one operation.
+/// @param latency Distribution to be updated.
+/// @param elapsed_ns Duration of the operation.
+/// @param delay_ns Part of the duration spent in simulated delays.
+void stats_record(struct LatencyStats *latency, uint64_t elapsed_ns,
+                  uint64_t delay_ns);
+
+/// Accounts time slept in a simulated delay to the calling thread.
+/// @param delay_ns Time slept.
+void stats_add_delay(uint64_t delay_ns);
+
+/// Returns and resets the delay accounted to the calling thread.
+/// @return Time slept in simulated delays since the previous call.
+uint64_t stats_take_delay(void);
+
+/// Adds the counters of one set of stats to another.
+/// @param dst Stats to be updated.
+/// @param src Stats to be added.
+void stats_merge(struct Stats *dst, const struct Stats *src);
+
+/// Writes stats to a file, one line per operation kind:
+/// <name> <count> <total_ns> <delay_ns> <bucket 0> ... <bucket 31>
+/// followed by "wait_ns <ns>" and "wall_ns <ns>".
+/// @param stats Stats to be written.
+/// @param path Path of the file.
+/// @return 0 if the file was written successfully, 1 otherwise.
+int stats_write(const struct Stats *stats, const char *path);
+
+/// Reads a file written by stats_write and adds it to stats.
+/// @param stats Stats to be updated.
+/// @param path Path of the file.
+/// @return 0 if the file was read successfully, 1 otherwise.
+int stats_read(struct Stats *stats, const char *path);
+
+/// Prints a human-readable summary.
+/// @param stats Stats to be printed.
+/// @param file Stream to print to.
+void stats_print(const struct Stats *stats, FILE *file);
+
+#endif // EMS_STATS_H
@@ -0,0 +1,368 @@
+#include "wal.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+#define WAL_COORD_CHUNK 64
+
+/// Writes a whole buffer to a file.
+/// @param fd File descriptor to write to.
+/// @param data Bytes to be written.
+/// @param len Number of bytes.
+/// @return 0 on success, 1 otherwise.
+static int write_all(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t bytes_written = write(fd, data, len);
+    if (bytes_written <= 0) {
+      return 1;
+    }
+    data += bytes_written;
+    len -= (size_t)bytes_written;
+  }
+  return 0;
+}
+
+/// Writes and syncs batches of records until the log is closed.
+/// @note A batch is taken once it is due: large enough, old enough, or
+/// awaited by wal_sync. Records logged while a batch is being written
+/// accumulate in the other buffer and form the next batch.
+/// @param arg Pointer to the struct Wal.
+/// @return NULL.
+static void *flusher_main(void *arg) {
+  struct Wal *wal = (struct Wal *)arg;
+
+  pthread_mutex_lock(&wal->lock);
+  while (1) {
+    while (wal->len == 0 && !wal->stop) {
+      pthread_cond_wait(&wal->pending, &wal->lock);
+    }
+    if (wal->len == 0) {
+      break;
+    }
+
+    while (!wal->stop && wal->syncs == 0 && wal->len < WAL_FLUSH_SIZE) {
+      uint64_t deadline =
+          wal->oldest_ns + (uint64_t)WAL_FLUSH_INTERVAL_MS * 1000000u;
+      if (stats_now() >= deadline) {
+        break;
+      }
+      struct timespec until = {(time_t)(deadline / 1000000000u),
+                               (long)(deadline % 1000000000u)};
+      pthread_cond_timedwait(&wal->pending, &wal->lock, &until);
+    }
+
+    char *batch = wal->buffer;
+    size_t batch_len = wal->len;
+    size_t batch_capacity = wal->capacity;
+    wal->buffer = wal->flushing;
+    wal->capacity = wal->flushing_capacity;
+    wal->flushing = batch;
+    wal->flushing_capacity = batch_capacity;
+    wal->len = 0;
+    uint64_t target = wal->logged;
+    pthread_mutex_unlock(&wal->lock);
+
+    int result =
+        write_all(wal->fd, batch, batch_len) || fdatasync(wal->fd) != 0;
+
+    pthread_mutex_lock(&wal->lock);
+    if (result) {
+      fprintf(stderr, "Error writing write-ahead log\n");
+      wal->failed = 1;
+    } else {
+      wal->durable = target;
+    }
+    pthread_cond_broadcast(&wal->flushed);
+  }
+  pthread_mutex_unlock(&wal->lock);
+  return NULL;
+}
+
+int wal_open(struct Wal *wal, const char *filepath, size_t valid_len) {
+  wal->fd = open(filepath, O_WRONLY | O_CREAT, 0666);
+  if (wal->fd == -1) {
+    fprintf(stderr, "Error opening file %s\n", filepath);
+    return 1;
+  }
+
+  int result = ftruncate(wal->fd, (off_t)valid_len) != 0;
+  if (!result && valid_len == 0) {
+    struct WalHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, WAL_MAGIC);
+    header.version = WAL_VERSION;
+    result = write_all(wal->fd, (const char *)&header, sizeof(header)) ||
+             fdatasync(wal->fd) != 0;
+  }
+  if (result || lseek(wal->fd, 0, SEEK_END) == -1) {
+    fprintf(stderr, "Error writing file %s\n", filepath);
+    close(wal->fd);
+    return 1;
+  }
+
+  wal->capacity = WAL_FLUSH_SIZE;
+  wal->flushing_capacity = WAL_FLUSH_SIZE;
+  wal->buffer = malloc(wal->capacity);
+  wal->flushing = malloc(wal->flushing_capacity);
+  if (wal->buffer == NULL || wal->flushing == NULL) {
+    fprintf(stderr, "Error allocating memory for write-ahead log\n");
+    free(wal->buffer);
+    free(wal->flushing);
+    close(wal->fd);
+    return 1;
+  }
+  wal->len = 0;
+  wal->logged = 0;
+  wal->durable = 0;
+  wal->oldest_ns = 0;
+  wal->syncs = 0;
+  wal->stop = 0;
+  wal->failed = 0;
+
+  // The flusher sleeps until a deadline on the monotonic clock
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_mutex_init(&wal->lock, NULL);
+  pthread_cond_init(&wal->pending, &attr);
+  pthread_cond_init(&wal->flushed, NULL);
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_create(&wal->flusher, NULL, flusher_main, wal) != 0) {
+    fprintf(stderr, "Failed to create thread\n");
+    pthread_cond_destroy(&wal->flushed);
+    pthread_cond_destroy(&wal->pending);
+    pthread_mutex_destroy(&wal->lock);
+    free(wal->buffer);
+    free(wal->flushing);
+    close(wal->fd);
+    return 1;
+  }
+  return 0;
+}
+
+/// Packs coordinates as uint32_t values.
+/// @param dst Where the values are stored.
+/// @param coords Coordinates to be packed.
+/// @param num_coords Number of coordinates.
+/// @return Pointer past the last value.
+static char *pack_coords(char *dst, const size_t *coords, size_t num_coords) {
+  for (size_t i = 0; i < num_coords; i++) {
+    uint32_t coord = (uint32_t)coords[i];
+    memcpy(dst, &coord, sizeof(coord));
+    dst += sizeof(coord);
+  }
+  return dst;
+}
+
+/// Adds a record to the pending batch.
+/// @param wal Log to append to.
+/// @param record Record to be appended.
+/// @param es Events of a TRANSACTION, NULL otherwise.
+/// @param xs Rows of a RESERVE or TRANSACTION, NULL otherwise.
+/// @param ys Columns of a RESERVE or TRANSACTION, NULL otherwise.
+/// @param num_seats Number of seats of a RESERVE or TRANSACTION, 0 otherwise.
+/// @return 0 on success, 1 if the log has failed.
+static int wal_append(struct Wal *wal, const struct WalRecord *record,
+                      const size_t *es, const size_t *xs, const size_t *ys,
+                      size_t num_seats) {
+  size_t columns = es != NULL ? 3 : 2;
+  size_t len = sizeof(*record) + columns * num_seats * sizeof(uint32_t);
+
+  pthread_mutex_lock(&wal->lock);
+  if (wal->failed) {
+    pthread_mutex_unlock(&wal->lock);
+    return 1;
+  }
+
+  if (wal->len + len > wal->capacity) {
+    size_t capacity = wal->capacity * 2;
+    if (capacity < wal->len + len) {
+      capacity = wal->len + len;
+    }
+    char *buffer = realloc(wal->buffer, capacity);
+    if (buffer == NULL) {
+      fprintf(stderr, "Error allocating memory for write-ahead log\n");
+      wal->failed = 1;
+      pthread_mutex_unlock(&wal->lock);
+      return 1;
+    }
+    wal->buffer = buffer;
+    wal->capacity = capacity;
+  }
+
+  if (wal->len == 0) {
+    wal->oldest_ns = stats_now();
+  }
+  char *dst = wal->buffer + wal->len;
+  memcpy(dst, record, sizeof(*record));
+  dst += sizeof(*record);
+  if (es != NULL) {
+    dst = pack_coords(dst, es, num_seats);
+  }
+  dst = pack_coords(dst, xs, num_seats);
+  pack_coords(dst, ys, num_seats);
+
+  // The flusher only needs waking to start a deadline or when it is due
+  if (wal->len == 0 || wal->len + len >= WAL_FLUSH_SIZE) {
+    pthread_cond_signal(&wal->pending);
+  }
+  wal->len += len;
+  wal->logged += len;
+  pthread_mutex_unlock(&wal->lock);
+  return 0;
+}
+
+int wal_log_create(struct Wal *wal, unsigned int event_id, size_t num_rows,
+                   size_t num_cols) {
+  struct WalRecord record;
+  memset(&record, 0, sizeof(record));
+  record.type = WAL_CREATE;
+  record.event_id = event_id;
+  record.arg0 = (uint32_t)num_rows;
+  record.arg1 = (uint32_t)num_cols;
+  return wal_append(wal, &record, NULL, NULL, NULL, 0);
+}
+
+int wal_log_reserve(struct Wal *wal, unsigned int event_id, size_t num_seats,
+                    const size_t *xs, const size_t *ys) {
+  struct WalRecord record;
+  memset(&record, 0, sizeof(record));
+  record.type = WAL_RESERVE;
+  record.event_id = event_id;
+  record.arg0 = (uint32_t)num_seats;
+  return wal_append(wal, &record, NULL, xs, ys, num_seats);
+}
+
+int wal_log_transaction(struct Wal *wal, size_t num_seats, const size_t *es,
+                        const size_t *xs, const size_t *ys) {
+  struct WalRecord record;
+  memset(&record, 0, sizeof(record));
+  record.type = WAL_TRANSACTION;
+  record.arg0 = (uint32_t)num_seats;
+  return wal_append(wal, &record, es, xs, ys, num_seats);
+}
+
+int wal_sync(struct Wal *wal) {
+  pthread_mutex_lock(&wal->lock);
+  uint64_t target = wal->logged;
+  wal->syncs++;
+  pthread_cond_signal(&wal->pending);
+  while (wal->durable < target && !wal->failed) {
+    pthread_cond_wait(&wal->flushed, &wal->lock);
+  }
+  wal->syncs--;
+  int result = wal->failed;
+  pthread_mutex_unlock(&wal->lock);
+  return result;
+}
+
+int wal_truncate(struct Wal *wal) {
+  if (wal_sync(wal)) {
+    return 1;
+  }
+  if (ftruncate(wal->fd, sizeof(struct WalHeader)) != 0 ||
+      lseek(wal->fd, 0, SEEK_END) == -1 || fdatasync(wal->fd) != 0) {
+    fprintf(stderr, "Error truncating write-ahead log\n");
+    return 1;
+  }
+  return 0;
+}
+
+int wal_close(struct Wal *wal) {
+  pthread_mutex_lock(&wal->lock);
+  wal->stop = 1;
+  pthread_cond_signal(&wal->pending);
+  pthread_mutex_unlock(&wal->lock);
+  pthread_join(wal->flusher, NULL);
+
+  int result = wal->failed;
+  if (close(wal->fd) != 0) {
+    fprintf(stderr, "Error closing file\n");
+    result = 1;
+  }
+  pthread_cond_destroy(&wal->flushed);
+  pthread_cond_destroy(&wal->pending);
+  pthread_mutex_destroy(&wal->lock);
+  free(wal->buffer);
+  free(wal->flushing);
+  return result;
+}
+
+int wal_read_header(struct Reader *reader) {
+  struct WalHeader header;
+  if (reader_read(reader, (char *)&header, sizeof(header)) !=
+          sizeof(header) ||
+      memcmp(header.magic, WAL_MAGIC, WAL_MAGIC_LEN) != 0 ||
+      header.version != WAL_VERSION) {
+    fprintf(stderr, "Invalid write-ahead log\n");
+    return 1;
+  }
+  return 0;
+}
+
+/// Reads packed uint32_t coordinates.
+/// @param reader Reader to read from.
+/// @param coords Array to store the coordinates in.
+/// @param num_coords Number of coordinates.
+/// @return 0 on success, 1 if the log ended early.
+static int read_coords(struct Reader *reader, size_t *coords,
+                       size_t num_coords) {
+  uint32_t chunk[WAL_COORD_CHUNK];
+  for (size_t i = 0; i < num_coords; i += WAL_COORD_CHUNK) {
+    size_t len = num_coords - i < WAL_COORD_CHUNK ? num_coords - i
+                                                  : WAL_COORD_CHUNK;
+    if (reader_read(reader, (char *)chunk, len * sizeof(uint32_t)) !=
+        len * sizeof(uint32_t)) {
+      return 1;
+    }
+    for (size_t j = 0; j < len; j++) {
+      coords[i + j] = chunk[j];
+    }
+  }
+  return 0;
+}
+
+int wal_next(struct Reader *reader, struct WalRecord *record,
+             struct CommandArgs *args, size_t *offset) {
+  if (reader_read(reader, (char *)record, sizeof(*record)) !=
+      sizeof(*record)) {
+    return 1;
+  }
+
+  size_t len = sizeof(*record);
+  switch (record->type) {
+  case WAL_CREATE:
+    break;
+  case WAL_RESERVE:
+    if (command_args_reserve(args, record->arg0) ||
+        read_coords(reader, args->xs, record->arg0) ||
+        read_coords(reader, args->ys, record->arg0)) {
+      return 1;
+    }
+    args->num_coords = record->arg0;
+    len += 2 * (size_t)record->arg0 * sizeof(uint32_t);
+    break;
+  case WAL_TRANSACTION:
+    if (command_args_reserve(args, record->arg0) ||
+        read_coords(reader, args->es, record->arg0) ||
+        read_coords(reader, args->xs, record->arg0) ||
+        read_coords(reader, args->ys, record->arg0)) {
+      return 1;
+    }
+    args->num_coords = record->arg0;
+    len += 3 * (size_t)record->arg0 * sizeof(uint32_t);
+    break;
+  default:
+    return 1;
+  }
+
+  *offset += len;
+  return 0;
+}
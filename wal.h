@@ -0,0 +1,146 @@
+#ifndef EMS_WAL_H
+#define EMS_WAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parser.h"
+#include "reader.h"
+
+// The write-ahead log is an append-only file with a record for every event
+// created and every reservation made, in the order they were applied to
+// each event. Replaying it on an empty state rebuilds the state.
+//
+// Records are not written one by one: they accumulate in memory and a
+// flusher thread writes and syncs them in batches (group commit), once
+// WAL_FLUSH_SIZE bytes are pending or WAL_FLUSH_INTERVAL_MS after the oldest
+// of them was logged, whichever comes first. wal_sync forces a batch and
+// waits for it, which makes everything logged before the call durable.
+//
+// Layout: a struct WalHeader followed by one struct WalRecord per change. A
+// RESERVE record is followed by its rows and then its columns, each as
+// num_seats packed uint32_t values. A TRANSACTION record is followed by the
+// events of its seats, then their rows and then their columns. Records are
+// written in native byte order. A record cut short by a crash ends the log,
+// so a transaction is replayed whole or not at all.
+
+#define WAL_MAGIC "EMSWAL1"
+#define WAL_MAGIC_LEN 8 // includes null terminator
+#define WAL_VERSION 1
+
+#define WAL_FLUSH_SIZE (1 << 16)
+#define WAL_FLUSH_INTERVAL_MS 5
+
+enum WalRecordType {
+  WAL_CREATE = 1, // Starts at 1 so that zeroed bytes never form a record
+  WAL_RESERVE = 2,
+  WAL_TRANSACTION = 3
+};
+
+struct WalHeader {
+  char magic[WAL_MAGIC_LEN];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+struct WalRecord {
+  uint8_t type;      // enum WalRecordType
+  uint8_t reserved[3];
+  uint32_t event_id; // Unused by TRANSACTION
+  uint32_t arg0;     // rows (CREATE), number of seats (RESERVE, TRANSACTION)
+  uint32_t arg1;     // columns (CREATE)
+};
+
+struct Wal {
+  int fd;                   /// Log file descriptor.
+  char *buffer;             /// Records not yet handed to the flusher.
+  size_t len;               /// Number of bytes in buffer.
+  size_t capacity;          /// Size of buffer, grows to fit large records.
+  char *flushing;           /// Batch being written by the flusher.
+  size_t flushing_capacity; /// Size of flushing.
+
+  uint64_t logged;    /// Bytes logged since the log was opened.
+  uint64_t durable;   /// Bytes logged and synced to the file.
+  uint64_t oldest_ns; /// When the oldest record in buffer was logged.
+  unsigned int syncs; /// Number of threads waiting in wal_sync.
+  int stop;           /// Asks the flusher to exit once buffer is empty.
+  int failed;         /// Set once a batch could not be written.
+
+  pthread_mutex_t lock;   /// Guards every field above but fd and flushing.
+  pthread_cond_t pending; /// Signalled when the flusher has work.
+  pthread_cond_t flushed; /// Signalled when durable advances.
+  pthread_t flusher;
+};
+
+/// Opens a log for appending and starts its flusher thread.
+/// @param wal Log to be initialized.
+/// @param filepath Path of the log, created if it does not exist.
+/// @param valid_len Length of the log that replay accepted. Anything after
+/// it, such as a record cut short by a crash, is discarded. 0 starts an
+/// empty log.
+/// @return 0 if the log was opened successfully, 1 otherwise.
+int wal_open(struct Wal *wal, const char *filepath, size_t valid_len);
+
+/// Logs the creation of an event.
+/// @param wal Log to append to.
+/// @param event_id Event id.
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @return 0 on success, 1 if the log has failed.
+int wal_log_create(struct Wal *wal, unsigned int event_id, size_t num_rows,
+                   size_t num_cols);
+
+/// Logs a reservation.
+/// @param wal Log to append to.
+/// @param event_id Event id.
+/// @param num_seats Number of seats.
+/// @param xs Rows of the seats.
+/// @param ys Columns of the seats.
+/// @return 0 on success, 1 if the log has failed.
+int wal_log_reserve(struct Wal *wal, unsigned int event_id, size_t num_seats,
+                    const size_t *xs, const size_t *ys);
+
+/// Logs a transaction, as a single record.
+/// @param wal Log to append to.
+/// @param num_seats Number of seats.
+/// @param es Events of the seats.
+/// @param xs Rows of the seats.
+/// @param ys Columns of the seats.
+/// @return 0 on success, 1 if the log has failed.
+int wal_log_transaction(struct Wal *wal, size_t num_seats, const size_t *es,
+                        const size_t *xs, const size_t *ys);
+
+/// Waits until every record logged so far is durable.
+/// @param wal Log to be synced.
+/// @return 0 on success, 1 if the log has failed.
+int wal_sync(struct Wal *wal);
+
+/// Discards every record, after they were saved somewhere else.
+/// @note No record may be logged concurrently.
+/// @param wal Log to be truncated.
+/// @return 0 on success, 1 otherwise.
+int wal_truncate(struct Wal *wal);
+
+/// Syncs a log, stops its flusher and closes it.
+/// @param wal Log to be closed.
+/// @return 0 if every record was made durable, 1 otherwise.
+int wal_close(struct Wal *wal);
+
+/// Reads and validates the header of a log.
+/// @param reader Reader positioned at the start of the log.
+/// @return 0 if the header is valid, 1 otherwise.
+int wal_read_header(struct Reader *reader);
+
+/// Reads the next record of a log.
+/// @param reader Reader positioned after the header.
+/// @param record Where the record is stored.
+/// @param args Arguments to store the seats of a RESERVE or TRANSACTION in,
+/// set up with command_args_init.
+/// @param offset Offset of the record in the log, advanced past it.
+/// @return 0 if a record was read, 1 at the end of the log or at the first
+/// incomplete or malformed record.
+int wal_next(struct Reader *reader, struct WalRecord *record,
+             struct CommandArgs *args, size_t *offset);
+
+#endif // EMS_WAL_H